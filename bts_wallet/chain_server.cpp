@@ -181,12 +181,14 @@ namespace detail
             
             block_message blk_msg;
             blk_msg.block_data = blk;
+            packed_message packed; // only serialized if some connection needs it
             for( auto itr = cons.begin(); itr != cons.end(); ++itr )
             {
                try {
                   if( itr->second->get_last_block_id() == blk.prev )
                   {
-                    itr->second->send( message( blk_msg ) );
+                    if( !packed ) packed = pack_message( message( blk_msg ) );
+                    itr->second->send( packed );
                     itr->second->set_last_block_id( blk.id() );
                   }
                } 
@@ -200,12 +202,13 @@ namespace detail
         {
             // copy list to prevent yielding in middle...
             auto cons = connections;
+            auto packed = pack_message( m );
             
             for( auto itr = cons.begin(); itr != cons.end(); ++itr )
             {
                try {
                  // todo... make sure connection is synced...
-                 itr->second->send( m );
+                 itr->second->send( packed );
                } 
                catch ( const fc::exception& w )
                {
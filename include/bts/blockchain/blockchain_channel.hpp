@@ -52,6 +52,12 @@ namespace bts { namespace blockchain {
        ~channel();
   
        network::channel_id get_id()const;
+
+       /**
+        *  Headers that start a chain at block 0 are only accepted while the
+        *  database is empty if the genesis block has this id.
+        */
+       void set_genesis_block_id( const block_id_type& id );
       
        /**
         *  All transactions that are known but that have not been included in 
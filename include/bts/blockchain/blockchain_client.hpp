@@ -2,7 +2,9 @@
 #include <bts/peer/peer_channel.hpp>
 #include <bts/extended_address.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/blockchain/block.hpp>
 #include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
 
 namespace bts { namespace blockchain {
 
@@ -21,10 +23,15 @@ namespace bts { namespace blockchain {
           }; 
 
           config()
-          :chan_num(bitshares_test_chan){}
+          :chan_num(bitshares_test_chan),address_index(false),prune(false),evaluation_threads(0){}
 
           fc::path     data_dir;
           chan_name    chan_num;
+          bool         address_index; ///< see blockchain_db::enable_address_index
+          bool         prune;         ///< keep BLOCKCHAIN_DEFAULT_PRUNE_DEPTH blocks of history, see blockchain_db::set_prune_depth
+          fc::optional<uint32_t> assume_valid_num; ///< checkpoint height, see blockchain_db::set_assume_valid
+          block_id_type          assume_valid_id;  ///< id of the block at assume_valid_num
+          uint32_t               evaluation_threads; ///< see blockchain_db::set_evaluation_threads
       };
 
       blockchain_client( const peer::peer_channel_ptr& peers );
@@ -62,4 +69,4 @@ namespace bts { namespace blockchain {
 } }  // namespace bts::blockchain
 
 FC_REFLECT_ENUM( bts::blockchain::blockchain_client::config::chan_name, (bitshares_test_chan)(bitshares_chan) )
-FC_REFLECT( bts::blockchain::blockchain_client::config, (data_dir)(chan_num) )
+FC_REFLECT( bts::blockchain::blockchain_client::config, (data_dir)(chan_num)(address_index)(prune)(assume_valid_num)(assume_valid_id)(evaluation_threads) )
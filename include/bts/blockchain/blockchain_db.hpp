@@ -113,6 +113,77 @@ namespace bts { namespace blockchain {
        meta_trx_output   meta_output;
     };
 
+    /**
+     *  Key of the optional address index, orders outputs by owner and
+     *  then by location in the chain.
+     */
+    struct address_output_key
+    {
+       address_output_key():output_idx(0){}
+       address_output_key( const address& a, const trx_num& t, uint8_t o )
+       :owner(a),trx(t),output_idx(o){}
+
+       address      owner;
+       trx_num      trx;
+       uint8_t      output_idx;
+
+       friend bool operator < ( const address_output_key& a, const address_output_key& b )
+       {
+          if( a.owner < b.owner ) return true;
+          if( b.owner < a.owner ) return false;
+          if( a.trx < b.trx     ) return true;
+          if( b.trx < a.trx     ) return false;
+          return a.output_idx < b.output_idx;
+       }
+       friend bool operator == ( const address_output_key& a, const address_output_key& b )
+       {
+          return a.owner == b.owner && a.trx == b.trx && a.output_idx == b.output_idx;
+       }
+    };
+
+    /**
+     *  Same as address_output_key for claim_by_pts outputs
+     */
+    struct pts_address_output_key
+    {
+       pts_address_output_key():output_idx(0){}
+       pts_address_output_key( const pts_address& a, const trx_num& t, uint8_t o )
+       :owner(a),trx(t),output_idx(o){}
+
+       pts_address  owner;
+       trx_num      trx;
+       uint8_t      output_idx;
+
+       friend bool operator < ( const pts_address_output_key& a, const pts_address_output_key& b )
+       {
+          if( a.owner < b.owner ) return true;
+          if( b.owner < a.owner ) return false;
+          if( a.trx < b.trx     ) return true;
+          if( b.trx < a.trx     ) return false;
+          return a.output_idx < b.output_idx;
+       }
+       friend bool operator == ( const pts_address_output_key& a, const pts_address_output_key& b )
+       {
+          return a.owner == b.owner && a.trx == b.trx && a.output_idx == b.output_idx;
+       }
+    };
+
+    /**
+     *  An output owned by an address as returned by blockchain_db::fetch_address_outputs
+     */
+    struct address_output
+    {
+       address_output():output_idx(0){}
+       address_output( const trx_num& t, const transaction_id_type& id, uint8_t o, const trx_output& out )
+       :trx(t),trx_id(id),output_idx(o),claim_func(out.claim_func),amount(out.amount){}
+
+       trx_num              trx;
+       transaction_id_type  trx_id; ///< identifies entries left behind by blocks that were replaced
+       uint8_t      output_idx;
+       claim_type   claim_func;
+       asset        amount;
+    };
+
     struct meta_trx : public signed_transaction
     {
        meta_trx(){}
@@ -182,6 +253,57 @@ namespace bts { namespace blockchain {
           void open( const fc::path& dir, bool create = true );
           void close();
 
+          /**
+           *  The address index maps the owner of every claim_by_signature, pts, bid,
+           *  long and cover output to the outputs it owns.  It is disabled by default
+           *  and must be enabled before open(), which will index any blocks that were
+           *  added while it was disabled.  Entries of blocks that are no longer part of
+           *  the chain are skipped and removed when they are next looked up.
+           */
+          void          enable_address_index( bool enable = true );
+          bool          has_address_index()const;
+
+          /**
+           *  A pruned node drops the bodies of transactions whose outputs were all spent
+           *  more than depth blocks ago, keeping block headers, trx ids of recent blocks 
+           *  and every unspent output.  The last depth blocks are always complete so that
+           *  they can be popped in a reorg.  A depth of 0 (the default) keeps the full
+           *  history.  Must be set before open(), see BLOCKCHAIN_DEFAULT_PRUNE_DEPTH.
+           */
+          void          set_prune_depth( uint32_t depth );
+          uint32_t      get_prune_depth()const;
+
+          /**
+           *  @return true if some of the transactions in block_num have been pruned, in which
+           *          case only the header and trx ids of the block are available.
+           */
+          bool          is_block_pruned( uint32_t block_num )const;
+
+          /**
+           *  Sets a checkpoint below which blocks may skip ECDSA recovery and signature 
+           *  requirements while still checking balances, double spends and market 
+           *  matching.  Only blocks passed to mark_assume_valid() skip them, the block 
+           *  height alone is never trusted.  Pushing a block_num that does not match id 
+           *  throws.  Pass INVALID_BLOCK_NUM to validate everything (the default).
+           */
+          void          set_assume_valid( uint32_t block_num, const block_id_type& id );
+          uint32_t      get_assume_valid_block_num()const;
+          block_id_type get_assume_valid_block_id()const;
+
+          /**
+           *  Records that the blocks in ids are ancestors of the assume valid checkpoint,
+           *  the caller must have verified that the headers of these blocks link our head
+           *  block to the checkpoint.
+           */
+          void          mark_assume_valid( const std::vector<block_id_type>& ids );
+
+          /**
+           *  Evaluates the transactions of large blocks on num_threads worker threads,
+           *  the totals and the reported failure are identical to serial evaluation.
+           *  Defaults to 0 which evaluates everything on the calling thread.
+           */
+          void          set_evaluation_threads( uint32_t num_threads );
+
           uint64_t      total_shares()const;
           uint32_t      head_block_num()const;
           block_id_type head_block_id()const;
@@ -207,23 +329,54 @@ namespace bts { namespace blockchain {
           *
           *  @throw exception if trx can not be applied to the current chain state.
           */
-         trx_eval   evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees = false, bool is_market = false );       
-         trx_eval   evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n = 0 );
+         trx_eval   evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees = false, bool is_market = false, 
+                                                 bool skip_signatures = false );       
+         trx_eval   evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n = 0,
+                                                  bool skip_signatures = false );
 
          std::vector<signed_transaction> match_orders( std::vector<price_point>* order_stats = nullptr );
          trx_block  generate_next_block( const std::vector<signed_transaction>& trx );
 
+         /**
+          *  @return true if the trx / block has been stored, unknown ids are usually
+          *          answered from memory without reading the database.
+          */
+         bool       is_known_trx( const transaction_id_type& trx_id );
+         bool       is_known_block( const block_id_type& block_id );
+
          trx_num    fetch_trx_num( const uint160& trx_id );
+         /** @throw if the trx has been pruned, see has_trx() */
          meta_trx   fetch_trx( const trx_num& t );
+         /** @return false if the trx was removed by pruning */
+         bool       has_trx( const trx_num& t );
 
          signed_transaction          fetch_transaction( const transaction_id_type& trx_id );
          std::vector<meta_trx_input> fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head = INVALID_BLOCK_NUM );
 
+         /**
+          *  @return up to limit outputs owned by owner starting from the output at start, in chain order
+          *  @pre has_address_index()
+          */
+         std::vector<address_output> fetch_address_outputs( const address& owner, 
+                                                            const trx_num& start = trx_num(0,0), 
+                                                            uint32_t limit = -1 );
+         std::vector<address_output> fetch_address_outputs( const pts_address& owner, 
+                                                            const trx_num& start = trx_num(0,0), 
+                                                            uint32_t limit = -1 );
+
          uint32_t     fetch_block_num( const block_id_type& block_id );
          block_header fetch_block( uint32_t block_num );
          full_block   fetch_full_block( uint32_t block_num );
+         /** @throw if is_block_pruned( block_num ) */
          trx_block    fetch_trx_block( uint32_t block_num );
 
+         /**
+          *  @return fc::raw::pack() of the full_block / trx_block with block_id, recently pushed
+          *          and requested blocks are served from an in memory cache.
+          */
+         std::shared_ptr<const std::vector<char> > fetch_packed_full_block( const block_id_type& block_id );
+         std::shared_ptr<const std::vector<char> > fetch_packed_trx_block( const block_id_type& block_id );
+
          uint64_t   current_bitshare_supply();
          
          /**
@@ -254,6 +407,9 @@ FC_REFLECT( bts::blockchain::trx_eval, (fees)(coindays_destroyed) )
 FC_REFLECT( bts::blockchain::trx_num, (block_num)(trx_idx) );
 FC_REFLECT( bts::blockchain::meta_trx_output, (trx_id)(input_num) )
 FC_REFLECT( bts::blockchain::meta_trx_input, (source)(output_num)(output)(meta_output) )
+FC_REFLECT( bts::blockchain::address_output_key, (owner)(trx)(output_idx) )
+FC_REFLECT( bts::blockchain::pts_address_output_key, (owner)(trx)(output_idx) )
+FC_REFLECT( bts::blockchain::address_output, (trx)(trx_id)(output_idx)(claim_func)(amount) )
 FC_REFLECT_DERIVED( bts::blockchain::meta_trx, (bts::blockchain::signed_transaction), (meta_outputs) );
 FC_REFLECT( bts::blockchain::bid_data, (bid_price)(amount)(is_short) )
 FC_REFLECT( bts::blockchain::ask_data, (ask_price)(amount) )
@@ -15,6 +15,9 @@ namespace bts { namespace blockchain {
       trxs_msg            = 8,
       full_block_msg      = 9,
       trx_block_msg       = 10,
+      block_not_available_msg = 11,
+      get_headers_msg     = 12,
+      headers_msg         = 13,
       message_type_count     /// used to verify message type range
   };
 
@@ -115,6 +118,42 @@ namespace bts { namespace blockchain {
      trx_block block_data;
   };
 
+  /**
+   *  Requests the headers that follow the most recent block in known that the
+   *  remote node has, used to fetch the header chain before downloading blocks.
+   */
+  struct get_headers_message
+  {
+      static const message_type type;
+      /** block ids from newest to oldest, going back in powers of 2 */
+      std::vector<block_id_type> known;
+  };
+
+  /**
+   *  Up to BLOCK_INV_QUERY_LIMIT consecutive headers in reply to get_headers_message,
+   *  a full reply means that more headers are available.
+   */
+  struct headers_message
+  {
+      static const message_type type;
+      std::vector<block_header> headers;
+  };
+
+  /**
+   *  Sent in reply to get_trx_block_message when the transactions of the 
+   *  block have been pruned and the node can only provide the full_block.
+   */
+  struct block_not_available_message
+  {
+     static const message_type type;
+
+     block_not_available_message(){}
+     block_not_available_message( const block_id_type& b )
+     :block_id(b){}
+
+     block_id_type block_id;
+  };
+
 
 } } // bts::blockchain
 FC_REFLECT_ENUM( bts::blockchain::message_type,
@@ -128,6 +167,9 @@ FC_REFLECT_ENUM( bts::blockchain::message_type,
   (trxs_msg)
   (full_block_msg)
   (trx_block_msg)
+  (block_not_available_msg)
+  (get_headers_msg)
+  (headers_msg)
 )
 
 FC_REFLECT( bts::blockchain::trx_inv_message, (items) )
@@ -140,4 +182,7 @@ FC_REFLECT( bts::blockchain::get_trx_block_message, (block_id) )
 FC_REFLECT( bts::blockchain::trxs_message, (trxs) )
 FC_REFLECT( bts::blockchain::full_block_message, (block_data) )
 FC_REFLECT( bts::blockchain::trx_block_message, (block_data) )
+FC_REFLECT( bts::blockchain::block_not_available_message, (block_id) )
+FC_REFLECT( bts::blockchain::get_headers_message, (known) )
+FC_REFLECT( bts::blockchain::headers_message, (headers) )
 
@@ -2,6 +2,7 @@
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/transaction.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/small_set.hpp>
 #include <fc/log/logger.hpp>
 
 namespace bts { namespace blockchain {
@@ -19,7 +20,8 @@ namespace bts { namespace blockchain {
     {
         public:
            /**
-            * @param t - the transaction that is being validated
+            * @param t - the transaction that is being validated, it is borrowed and
+            *            must outlive this state.
             *
             * @param head_idx - the head index to evaluate this
             * transaction against.  This should be the prior block
@@ -31,9 +33,12 @@ namespace bts { namespace blockchain {
                                 uint32_t  head_idx = -1
                                 );
            bool allow_short_long_matching;
+           /** 
+            *  Set for blocks below the assume valid checkpoint, signatures are only recovered 
+            *  when a bid or long input needs to know whether its owner signed.
+            */
+           bool skip_signatures;
 
-           trx_validation_state() : trx(signed_transaction()) {}
-           
            /** tracks the sum of all inputs and outputs for a particular
             * asset type in the balance_sheet 
             */
@@ -51,7 +56,6 @@ namespace bts { namespace blockchain {
                  sum -= int64_t(neg_in.amount.high_bits());
                  sum -= int64_t(out.amount.high_bits());
                  sum += int64_t(neg_out.amount.high_bits());
-                 ilog( "is blanced sum ${s} ${u}", ("s",sum)("u",in.unit));
                  return abs(sum) <= 2;
               }
               bool creates_money()const 
@@ -60,7 +64,6 @@ namespace bts { namespace blockchain {
                  sum -= int64_t(neg_in.amount.high_bits());
                  sum -= int64_t(out.amount.high_bits());
                  sum += int64_t(neg_out.amount.high_bits());
-                 ilog( "is blanced sum ${s} ${u}", ("s",sum)("u",in.unit));
                  if(  abs(sum) <= 2 ) return false;
                  return sum < 0;
              }
@@ -68,12 +71,10 @@ namespace bts { namespace blockchain {
                  //return ((in - neg_in) - (out - neg_out)).amount >= fc::uint128(0); }
            };
 
-           /** this is cost because validation shouldn't modify the trx and
-            * is captured by value rather than reference just in case we need 
-            * thread safety of some kind... for performance see if we can
-            * capture it by reference later.
+           /** validation doesn't modify the trx, it is borrowed from the caller
+            * so that validating does not copy every transaction. 
             */
-           const signed_transaction            trx; // TODO make reference?
+           const signed_transaction&           trx;
            uint64_t total_cdd;
            uint64_t uncounted_cdd;
 
@@ -91,15 +92,15 @@ namespace bts { namespace blockchain {
             * process inputs we track which outputs have been used and make sure
             * there are no duplicates.
             */
-           std::unordered_set<uint8_t>         used_outputs;
-           std::unordered_set<address>         signed_addresses;
+           small_set<uint8_t,8>                used_outputs;
+           small_set<address,4>                signed_addresses;
 
            /**
             *  contains all addresses for which a signature is required,
             *  this is validated last with the exception of multi-sig or
             *  escrow inputs which have optional signatures.
             */
-           std::unordered_set<address>         required_sigs;
+           small_set<address,4>                required_sigs;
 
            /** dividends earned in the past 100 blocks that are counted toward
              * transaction fees.
@@ -116,6 +117,10 @@ namespace bts { namespace blockchain {
            void validate();
         private:
            static const uint16_t output_not_found = uint16_t(-1);
+           /** signature recovery is expensive so signed_addresses is only populated on demand */
+           void     load_signed_addresses();
+           bool     _signed_addresses_loaded;
+
            void     mark_output_as_used( uint16_t output_number );
            uint16_t find_unused_sig_output( const address& a, const asset& bal );
            uint16_t find_unused_bid_output( const claim_by_bid_output& b );
@@ -148,7 +153,7 @@ namespace bts { namespace blockchain {
 } } // bts::blockchain
 FC_REFLECT( bts::blockchain::trx_validation_state::asset_balance, (in)(neg_in)(collat_in)(out)(neg_out)(collat_out) )
 FC_REFLECT( bts::blockchain::trx_validation_state, 
-    (trx)
+    // trx is a reference and cannot be reflected, validate() adds it to the error context
     (inputs)
     (ref_head)
     //(dividends)
@@ -0,0 +1,94 @@
+#pragma once
+#include <fc/io/raw.hpp>
+#include <fc/time.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace bts 
+{
+  /**
+   *  A fixed size probabilistic set.  contains() never returns false for an
+   *  item that was inserted, but may return true for an item that was not
+   *  with a probability close to the false_positive_rate the filter was
+   *  sized for.  Items can not be removed, only the whole filter cleared.
+   */
+  class bloom_filter
+  {
+     public:
+        bloom_filter( uint64_t expected_items = 1024, double false_positive_rate = 0.0001 );
+
+        void     insert( const char* data, size_t len );
+        bool     contains( const char* data, size_t len )const;
+
+        template<typename T>
+        void     insert( const T& item )
+        {
+           auto packed = fc::raw::pack( item );
+           insert( packed.data(), packed.size() );
+        }
+
+        template<typename T>
+        bool     contains( const T& item )const
+        {
+           auto packed = fc::raw::pack( item );
+           return contains( packed.data(), packed.size() );
+        }
+
+        void     clear();
+
+        /** the number of insert() calls since the last clear */
+        uint64_t size()const              { return _item_count; }
+        uint64_t capacity()const          { return _expected_items; }
+        /** true once more items were inserted than the filter was sized for */
+        bool     is_saturated()const      { return _item_count > _expected_items; }
+        size_t   memory_usage()const      { return _bits.size() * sizeof(uint64_t); }
+
+     private:
+        uint64_t               _expected_items;
+        uint64_t               _item_count;
+        uint64_t               _bit_count;
+        uint32_t               _hash_count;
+        std::vector<uint64_t>  _bits;
+  };
+
+  /**
+   *  Remembers recently inserted items in a fixed amount of memory by alternating
+   *  between two bloom filters.  Items are inserted into the current filter and
+   *  looked up in both.  Once the current filter holds items_per_generation items 
+   *  or is older than max_age it replaces the previous filter, so an item is 
+   *  remembered for at least one full generation.
+   */
+  class rolling_bloom_filter
+  {
+     public:
+        rolling_bloom_filter( uint64_t items_per_generation, double false_positive_rate, 
+                              const fc::microseconds& max_age );
+
+        template<typename T>
+        void     insert( const T& item )
+        {
+           rotate_if_needed();
+           _current.insert( item );
+        }
+
+        template<typename T>
+        bool     contains( const T& item )const
+        {
+           auto packed = fc::raw::pack( item );
+           return _current.contains( packed.data(), packed.size() ) || 
+                  _previous.contains( packed.data(), packed.size() );
+        }
+
+        void     clear();
+        size_t   memory_usage()const { return _current.memory_usage() + _previous.memory_usage(); }
+
+     private:
+        void     rotate_if_needed();
+
+        fc::microseconds  _max_age;
+        fc::time_point    _generation_start;
+        bloom_filter      _current;
+        bloom_filter      _previous;
+  };
+
+} // namespace bts
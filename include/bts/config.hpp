@@ -24,11 +24,25 @@
  */
 
 #define NETWORK_DEFAULT_PORT             (0) //(9876)
+#define NETWORK_SEND_QUEUE_HIGH_WATER    (4*1024*1024)  // bytes queued for a connection before it is considered congested
+#define NETWORK_SEND_QUEUE_MAX           (32*1024*1024) // bytes queued for a connection before it is disconnected as too slow
+#define NETWORK_CONGESTED_RETRY_MS       (250)          // delay before inventory held back from congested connections is broadcast again
+#define NETWORK_MAX_CRYPT_CHUNK          (1024*1024)    // largest write stcp_socket encrypts at once
+#define NETWORK_CRYPTO_THREADS           (2)            // worker threads used for handshake key generation and ECDH
+#define NETWORK_EPHEMERAL_KEY_POOL_SIZE  (64)           // handshake keys generated ahead of time
+#define NETWORK_BUFFER_POOL_SIZE         (64*1024*1024) // idle message payload storage kept for reuse
+#define NETWORK_MAX_COALESCED_WRITE      (64*1024)      // queued messages are combined into socket writes of up to this size
+#define NETWORK_KNOWN_INV_FILTER_ITEMS   (16*1024)      // inventory items per generation of a connection's known inventory filter, each generation is about 29 KB
+#define NETWORK_KNOWN_INV_FILTER_FP_RATE (0.001)        // chance that an item is wrongly assumed to be known by a peer
+#define NETWORK_KNOWN_INV_WINDOW_SEC     (60*10)        // seconds before a generation of the known inventory filter is replaced
+#define NETWORK_COMPRESSION_THRESHOLD    (1024)         // smallest message data that is compressed on channels that allow it
 #define BITNAME_BLOCK_INTERVAL_SEC       (2*60)  // 2 minutes
 #define BITNAME_TIMEKEEPER_WINDOW        (64)    // blocks used for estimating time
 #define BITNAME_BLOCK_FETCH_TIMEOUT_SEC  (60)
 #define RPC_DEFAULT_PORT                 (0) // (NETWORK_DEFAULT_PORT+1)
 #define WALLET_INVALID_INDEX             (uint32_t(-1))
+#define KEYCHAIN_CACHE_MAX_KEYS          (4096)  // derived keys cached per keychain map before it is cleared
+#define KEYCHAIN_PRIVATE_KEY_CACHE_SEC   (60)    // seconds derived private keys stay cached
 #define COIN                          (100000000ll)
 
 #define SHARE                         (1000ll)                    // used to position the decimal place
@@ -59,11 +73,25 @@
 #define MIN_NAME_DIFFICULTY           (32)                // number if leeding 0 bits in double sha512 required to register a name
 //#define MIN_NAME_DIFFICULTY           (16)              // number if leeding 0 bits in double sha512 required to register a name
 #define PEER_HOST_CACHE_QUERY_LIMIT   (1000)              // number of ip/ports that we will cache
+#define PEER_DB_MAX_AGE_SEC           (60*60*24*30)       // hosts not heard from in this long are removed from the peer db
+#define PEER_DB_MAX_HOSTS             (8*1024)            // hosts kept in the peer db, the lowest scoring host is evicted to make room
+#define PEER_RETRY_BACKOFF_SEC        (30)                // wait before retrying a host after its first failure, doubles per failure
+#define PEER_MAX_RETRY_BACKOFF_SEC    (60*60*6)           // longest wait before retrying a failing host
+#define PEER_TARGET_HANDSHAKE_US      (200*1000)          // handshake time at which a host's speed score is halved
+#define PEER_CONNECT_INTERVAL_SEC     (3)                 // seconds between connect rounds once no candidates remain
 #define MAX_CHANNELS_PER_CONNECTION   (32)
 
 // blockchain channel config
 #define TRX_INV_QUERY_LIMIT           (2000) // number of trx that may be sent as part of inventory or request msg
 #define BLOCK_INV_QUERY_LIMIT         (2000) // number of trx that may be sent as part of inventory or request msg
+#define BLOCKCHAIN_SYNC_WINDOW                  (256)  // blocks past the head that may be requested / buffered during sync
+#define BLOCKCHAIN_SYNC_MAX_REQUESTS_PER_PEER   (16)   // outstanding block requests per connection during sync
+#define BLOCKCHAIN_SYNC_TIMEOUT_SEC             (30)   // seconds before a block request is sent to another peer
+
+// blockchain db config
+#define BLOCKCHAIN_DEFAULT_PRUNE_DEPTH          (BLOCKS_PER_DAY*2)   // blocks of history kept by a pruned node for reorgs
+#define BLOCKCHAIN_PRUNE_COMPACTION_INTERVAL    (BLOCKS_PER_HOUR*4)  // blocks between background compactions of pruned data
+#define BLOCKCHAIN_BLOCK_CACHE_SIZE             (64*1024*1024)       // bytes of packed blocks kept for serving peers
 
 
 /**
@@ -146,7 +146,8 @@ namespace bts { namespace db {
 
         iterator lower_bound( const Key& key )
         { try {
-           ldb::Slice key_slice( (char*)&key, sizeof(key) );
+           std::vector<char> kslice = fc::raw::pack( key );
+           ldb::Slice key_slice( kslice.data(), kslice.size() );
            iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
            itr._it->Seek( key_slice );
            if( itr.valid()  ) 
@@ -227,6 +228,15 @@ namespace bts { namespace db {
              }
           } FC_RETHROW_EXCEPTIONS( warn, "error removing ${key}", ("key",k) );
         }
+
+        /**
+         *  Compacts the entire key range, reclaiming the space used by removed
+         *  items.  This may take a long time and is safe to call from another thread.
+         */
+        void compact()
+        {
+           _db->CompactRange( nullptr, nullptr );
+        }
         
 
      private:
@@ -2,9 +2,13 @@
 #include <fc/crypto/elliptic.hpp>
 #include <bts/extended_address.hpp>
 #include <functional>
+#include <memory>
+#include <vector>
 
 namespace bts {
 
+  namespace detail { class keychain_cache; }
+
   /** 
    *  HD Wallet (Hierarchical-Deterministic Wallets) are loosly based upon 
    *  Bitcoin Improvement Proposal 0032  https://en.bitcoin.it/wiki/BIP_0032
@@ -34,11 +38,20 @@ namespace bts {
    *
    *  The intended use is for accounts to be created via private derivation,
    *  while trx and address children are created via public derivation.
+   *
+   *  Intermediate identity, account and trx keys are cached so that walking
+   *  the addresses of a trx only pays for the final derivation step.  Every
+   *  copy of a keychain starts with its own empty cache, which is reset by 
+   *  set_seed().  A keychain must not be used by several threads at once.
    */
   class keychain 
   {
      public:
         keychain();
+        keychain( const keychain& k );
+        ~keychain();
+
+        keychain& operator=( const keychain& k );
 
         /**
          *  This method will take several minutes to run and is designed to
@@ -60,8 +73,18 @@ namespace bts {
         extended_private_key  get_private_trx( const std::string& ident, uint32_t account, uint32_t trx );
         fc::ecc::private_key  get_private_trx_address( const std::string& ident, uint32_t account, uint32_t trx, uint32_t addr );
 
+        /**
+         *  Derives the addresses [first_addr, first_addr+count) of a trx, the parent
+         *  trx key is only derived once and large ranges are split across threads.
+         */
+        std::vector<fc::ecc::public_key>  get_public_trx_addresses( const std::string& ident, uint32_t account, uint32_t trx, 
+                                                                    uint32_t first_addr, uint32_t count );
+        std::vector<fc::ecc::private_key> get_private_trx_addresses( const std::string& ident, uint32_t account, uint32_t trx, 
+                                                                     uint32_t first_addr, uint32_t count );
+
      private:
-       extended_private_key  ext_priv_key;
+       extended_private_key                     ext_priv_key;
+       std::unique_ptr<detail::keychain_cache>  _cache;
   };
 
 } // bts
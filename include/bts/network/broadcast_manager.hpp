@@ -1,5 +1,8 @@
 #pragma once
+#include <bts/bloom_filter.hpp>
+#include <bts/config.hpp>
 #include <deque>
+#include <set>
 #include <unordered_map>
 #include <fc/exception/exception.hpp>
 #include <fc/reflect/variant.hpp>
@@ -20,32 +23,32 @@ namespace bts { namespace network {
       broadcast_manager()
       :_new_since_broadcast(false){}
 
+      /**
+       *  Tracks what a connection knows about and has requested.  Known keys are kept
+       *  in a rolling bloom filter so the memory used is fixed, about 60 KB with the
+       *  default settings.  A false positive only means the connection is not told 
+       *  about an item.
+       */
       class channel_data 
       {
          public:
+           channel_data( uint64_t items_per_generation = NETWORK_KNOWN_INV_FILTER_ITEMS, 
+                         double false_positive_rate    = NETWORK_KNOWN_INV_FILTER_FP_RATE,
+                         const fc::microseconds& max_age = fc::seconds( NETWORK_KNOWN_INV_WINDOW_SEC ) )
+           :_known_keys( items_per_generation, false_positive_rate, max_age ){}
+
            void update_known( const Key& known )
            {
-              _known_keys[known] = fc::time_point::now();
+              if( !_known_keys.contains( known ) ) // keep repeats from filling the generation
+              {
+                 _known_keys.insert( known );
+              }
            }
            void update_known( const std::vector<Key>& known )
            {
              for( auto itr = known.begin(); itr != known.end(); ++itr )
              {
-               _known_keys[*itr] = fc::time_point::now();
-             }
-           }
-           void clear_old( const fc::time_point& old )
-           {
-             for( auto itr = _known_keys.begin(); itr != _known_keys.end(); )
-             {
-                if( *itr < old )
-                {
-                  itr= _known_keys.erase(itr);
-                }
-                else
-                {
-                  ++itr;
-                }
+               update_known( *itr );
              }
            }
 
@@ -60,7 +63,7 @@ namespace bts { namespace network {
            }
            bool knows( const Key& k )const
            {
-             return _known_keys.find(k) != _known_keys.end();
+             return _known_keys.contains(k);
            }
            bool has_pending_request()const
            {
@@ -70,46 +73,47 @@ namespace bts { namespace network {
            {
               _requested_values[k] = fc::time_point::now();
            }
-           const std::unordered_map<Key,fc::time_point>& known_keys()const
-           {
-             return _known_keys;
-           }
          private:
-          std::unordered_map<Key,fc::time_point>  _known_keys;
+          bts::rolling_bloom_filter               _known_keys;
           std::unordered_map<Key,fc::time_point>  _requested_values;
       };
 
       void  received_inventory_notice( const Key& k )
       {
-         auto itr = _inventory.find(k);
-         if( itr != _inventory.end() )
+         item_state& state = _inventory[k];
+         if( state.value || state.inv_count < 0 )
          {
-           ++itr->second.inv_count;
+            return; // already have it or already asked for it
          }
-         else
+         if( state.inv_count == 0 )
          {
-           _inventory[k].inv_count = 1;
+            state.first_seen = fc::time_point::now();
          }
+         dequeue( k, state );
+         ++state.inv_count;
+         _query_queue.insert( query_priority( state, k ) );
       }
 
+      /**
+       *  @return the item announced by the most connections, or the oldest of 
+       *          those announced equally often.
+       */
       bool find_next_query( Key& key )const
       {
-        int32_t high_count = 0;
-        for( auto itr = _inventory.begin(); itr != _inventory.end(); ++itr )
+        if( _query_queue.empty() )
         {
-          if( itr->second.inv_count > high_count )
-          {
-             high_count = itr->second.inv_count;
-             key = itr->first;
-          }
+           return false;
         }
-        return high_count != 0;
+        key = _query_queue.begin()->key;
+        return true;
       }
 
       void  item_queried( const Key& key )
       {
-          _inventory[key].query_time = fc::time_point::now();
-          _inventory[key].inv_count  = -10000; // flag so we don't query again
+          item_state& state = _inventory[key];
+          dequeue( key, state );
+          state.query_time = fc::time_point::now();
+          state.inv_count  = -10000; // flag so we don't query again
       }
 
       const fc::optional<Value>& get_value( const Key& key )
@@ -129,6 +133,7 @@ namespace bts { namespace network {
          wlog( "${key}   ${value}   ${ok}", ("key",key)("value",value)("ok",is_ok) );
          item_state& state = _inventory[key];
          FC_ASSERT( !state.value, "duplicate value received", ("value",value)("current",*state.value)("key",key) );
+         dequeue( key, state );
          state.recv_time = fc::time_point::now();
          state.value     = value;
          state.valid     = is_ok;
@@ -138,7 +143,12 @@ namespace bts { namespace network {
 
       void  remove( const Key& key )
       {
-          _inventory.erase(key);
+          auto itr = _inventory.find(key);
+          if( itr != _inventory.end() )
+          {
+             dequeue( itr->first, itr->second );
+             _inventory.erase(itr);
+          }
       }
 
       void remove_invalid()
@@ -148,6 +158,7 @@ namespace bts { namespace network {
          {
            if( !itr->second.valid && itr->second.recv_time < expire_time )
            {
+              dequeue( itr->first, itr->second );
               itr = _inventory.erase(itr);
            }
            else
@@ -170,7 +181,7 @@ namespace bts { namespace network {
          {
            if( itr->second.value && itr->second.valid )
            {
-               if( filter.known_keys().find( itr->first ) == filter.known_keys().end() )
+               if( !filter.knows( itr->first ) )
                {
                   unique_items.push_back( itr->first ); 
                }
@@ -206,6 +217,7 @@ namespace bts { namespace network {
       {
          _new_since_broadcast = false;
          _inventory.clear();
+         _query_queue.clear();
       }
 
       /**
@@ -229,6 +241,7 @@ namespace bts { namespace network {
          {
             if( itr->second.recv_time < old )
             {
+               dequeue( itr->first, itr->second );
                itr = _inventory.erase( itr );
             }
             else
@@ -256,6 +269,7 @@ namespace bts { namespace network {
         :inv_count(0),valid(false){ assert(!value); }
 
         int32_t               inv_count; ///< how many inventory msgs have I received
+        fc::time_point        first_seen; ///< when the first inventory msg was received
         fc::time_point        recv_time;
         fc::time_point        query_time;
         bool                  valid;
@@ -263,9 +277,40 @@ namespace bts { namespace network {
       };
 
 
+      /** 
+       *  Orders items that have been announced but not yet queried, the most 
+       *  announced first and then the oldest.
+       */
+      struct query_priority
+      {
+        query_priority( const item_state& s, const Key& k )
+        :inv_count(s.inv_count),first_seen(s.first_seen),key(k){}
+
+        friend bool operator < ( const query_priority& a, const query_priority& b )
+        {
+           if( a.inv_count != b.inv_count ) return a.inv_count > b.inv_count;
+           if( a.first_seen != b.first_seen ) return a.first_seen < b.first_seen;
+           return a.key < b.key;
+        }
+
+        int32_t               inv_count;
+        fc::time_point        first_seen;
+        Key                   key;
+      };
+
+      /** removes key from the query queue if it is waiting to be queried */
+      void dequeue( const Key& key, const item_state& state )
+      {
+         if( state.inv_count > 0 )
+         {
+            _query_queue.erase( query_priority( state, key ) );
+         }
+      }
+
       bool                                  _new_since_broadcast;
       fc::optional<Value>                   _unknown_value;
       std::unordered_map<Key,item_state>    _inventory;
+      std::set<query_priority>              _query_queue;
   };
 
 } } 
@@ -75,10 +75,42 @@ namespace bts { namespace network {
          */
         void             set_channel_data( const channel_id& c, const channel_data_ptr& d );
    
+        /**
+         *  Queues m to be written by this connection's writer task and returns
+         *  immediately.  Connections that fall more than NETWORK_SEND_QUEUE_MAX
+         *  bytes behind are closed.
+         */
         void send( const message& m );
+
+        /** Queues a frame built by pack_message(), the frame is shared and never modified */
+        void send( const packed_message& m );
+
+        /**
+         *  Messages on chan with at least NETWORK_COMPRESSION_THRESHOLD bytes of data are
+         *  sent compressed with t.  Only set once the remote node has advertised support for t.
+         */
+        void             set_compression( const channel_id& chan, compression_type t );
+        compression_type get_compression( const channel_id& chan )const;
+
+        /** @return the number of bytes read from the socket since the connection was opened */
+        uint64_t bytes_received()const;
+
+        /** @return the number of bytes waiting to be written to the socket */
+        uint64_t queued_send_bytes()const;
+
+        /** 
+         *  @return true once more than NETWORK_SEND_QUEUE_HIGH_WATER bytes are queued,
+         *          optional traffic such as inventory should be held back.
+         */
+        bool     is_congested()const;
    
         void connect( const std::string& host_port );  
         void connect( const fc::ip::endpoint& ep );
+
+        /**
+         *  Closes the socket, frames still waiting in the send queue are discarded
+         *  rather than flushed so a stalled peer cannot hold up the caller.
+         */
         void close();
 
       private:
@@ -0,0 +1,50 @@
+#pragma once
+#include <fc/crypto/elliptic.hpp>
+#include <fc/thread/future.hpp>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fc { class thread; }
+
+namespace bts { namespace network {
+
+  /**
+   *  Moves the expensive parts of securing a connection off the thread that owns 
+   *  the socket.  ECDH runs on worker threads while the calling task yields, so 
+   *  other tasks on the owning thread (such as block validation) keep running 
+   *  during a burst of new connections.  Ephemeral keys are generated ahead of 
+   *  time in the background.
+   *
+   *  Jobs capture their inputs by value, so a worker never touches freed memory 
+   *  when the waiting task is canceled.  Bulk AES stays on the socket's thread, 
+   *  handing it to a worker would mean copying every buffer in and out again.
+   */
+  class crypto_pool
+  {
+     public:
+        crypto_pool( uint32_t num_threads );
+        ~crypto_pool();
+
+        /** shared by every stcp_socket in the process */
+        static crypto_pool& instance();
+
+        /** @return a key that has not been handed out before */
+        fc::ecc::private_key take_ephemeral_key();
+
+        fc::sha512           get_shared_secret( const fc::ecc::private_key& k, const fc::ecc::public_key& remote );
+
+     private:
+        fc::thread&          next_thread();
+        void                 refill_keys();
+
+        std::vector<std::unique_ptr<fc::thread> > _threads;
+        uint32_t                                  _next_thread;
+
+        std::mutex                                _key_lock;
+        std::deque<fc::ecc::private_key>          _keys;
+        fc::future<void>                          _refill_complete;
+  };
+
+} } // bts::network
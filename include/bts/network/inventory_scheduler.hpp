@@ -0,0 +1,43 @@
+#pragma once
+#include <fc/thread/future.hpp>
+#include <fc/time.hpp>
+#include <functional>
+
+namespace bts { namespace network {
+
+  /**
+   *  Runs a channel's fetch / broadcast work only when there is something to
+   *  do instead of polling.  Channels call notify() when inventory arrives or 
+   *  state changes, and notify_at() for deadlines such as request timeouts.  
+   *  Notifications that arrive while the work is running cause it to run once 
+   *  more, several notifications before it runs are combined into one call.
+   */
+  class inventory_scheduler
+  {
+     public:
+        inventory_scheduler();
+        ~inventory_scheduler();
+
+        /** starts a task on the current thread that calls work when notified */
+        void start( const std::function<void()>& work );
+
+        /** stops the task, waits for any call to work in progress to finish and releases work */
+        void stop();
+
+        /** run the work as soon as the current task yields */
+        void notify();
+
+        /** run the work no later than t, earlier deadlines take precedence */
+        void notify_at( const fc::time_point& t );
+
+     private:
+        void run();
+
+        std::function<void()>  _work;
+        bool                   _stopping;
+        fc::time_point         _wake_time;
+        fc::promise<void>::ptr _wake;
+        fc::future<void>       _run_complete;
+  };
+
+} } // bts::network
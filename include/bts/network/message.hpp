@@ -5,6 +5,9 @@
 #include <fc/io/varint.hpp>
 #include <fc/network/ip.hpp>
 #include <fc/io/raw.hpp>
+#include <fc/optional.hpp>
+#include <memory>
+#include <string.h>
 
 namespace bts { namespace network {
 
@@ -24,6 +27,7 @@ namespace bts { namespace network {
 
   };
   #define PACKED_MESSAGE_HEADER 8
+  #define MESSAGE_COMPRESSED_FLAG 0x8000 // set in msg_type when data is compressed
   #define MESSAGE_HEADER_SIZE_FIELD_SIZE 3
 
 //TODO: MSVC is padding message_header, so for now we're packing it before writing it. We could change
@@ -60,6 +64,22 @@ namespace bts { namespace network {
         data     = fc::raw::pack(m);
         size     = data.size();
      }
+
+     /**
+      *  Builds a message of type T from a payload that was already 
+      *  serialized with fc::raw::pack( T ), such as a cached block.
+      */
+     template<typename T>
+     static message from_packed( const std::vector<char>& packed, const channel_id cid = channel_id() )
+     {
+        message m;
+        m.proto    = cid.proto;
+        m.chan_num = cid.chan;
+        m.msg_type = T::type;
+        m.data     = packed;
+        m.size     = m.data.size();
+        return m;
+     }
     
      /**
       *  Automatically checks the type and deserializes T in the
@@ -92,9 +112,64 @@ namespace bts { namespace network {
      }
   };
 
+  /**
+   *  Codecs that may be negotiated for a channel on a connection.
+   */
+  enum compression_type
+  {
+     no_compression   = 0,
+     zlib_compression = 1 // deflate at Z_BEST_SPEED, cheap enough to run for every connection
+  };
+
+  /**
+   *  @return m with its data compressed and MESSAGE_COMPRESSED_FLAG set in msg_type, or
+   *          an invalid optional if compressing would not make the message smaller.
+   */
+  fc::optional<message> compress_message( const message& m, compression_type t );
+
+  /**
+   *  @pre m.msg_type & MESSAGE_COMPRESSED_FLAG 
+   *  @return the uncompressed data of m 
+   */
+  std::vector<char>     decompress_data( const message& m );
+
+  /**
+   *  The bytes of a message exactly as they are written to a connection: the
+   *  packed header followed by the data and padded to a multiple of 16 bytes.
+   *  The frame is immutable so one copy can be shared by every connection a 
+   *  message is broadcast to, leaving only the encryption to be done per peer.
+   */
+  typedef std::shared_ptr<const std::vector<char> > packed_message;
+
+  inline packed_message pack_message( const message& m )
+  {
+     size_t len = PACKED_MESSAGE_HEADER + m.size;
+     len = 16*((len+15)/16); //pad the message we send to a multiple of 16 bytes
+     auto frame = std::make_shared<std::vector<char> >(len);
+     std::vector<char>& tmp = *frame;
+     #ifndef WIN32
+       memcpy( tmp.data(), (char*)&m, PACKED_MESSAGE_HEADER );
+     #else
+        // TODO: clean this up
+        char* tmpPtr = tmp.data();
+        memcpy( tmpPtr, (char*)(&m), MESSAGE_HEADER_SIZE_FIELD_SIZE );
+        tmpPtr += MESSAGE_HEADER_SIZE_FIELD_SIZE;
+        memcpy( tmpPtr, (char*)&(m.proto), sizeof(m.proto) );
+        tmpPtr += sizeof(m.proto);
+        memcpy( tmpPtr, (char*)&(m.chan_num), sizeof(m.chan_num) );
+        tmpPtr += sizeof(m.chan_num);
+        memcpy( tmpPtr, (char*)&(m.msg_type), sizeof(m.msg_type) );
+     #endif
+     if( m.size )
+     {
+        memcpy( tmp.data() + PACKED_MESSAGE_HEADER, m.data.data(), m.size );
+     }
+     return frame;
+  }
 
 } } // bts::network
 
 
 FC_REFLECT( bts::network::message_header, (proto)(chan_num)(msg_type) )
+FC_REFLECT_ENUM( bts::network::compression_type, (no_compression)(zlib_compression) )
 //FC_REFLECT_DERIVED( bts::network::message, (bts::network::message_header), (data) )
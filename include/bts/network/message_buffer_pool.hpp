@@ -0,0 +1,69 @@
+#pragma once
+#include <fc/reflect/reflect.hpp>
+#include <array>
+#include <mutex>
+#include <vector>
+
+namespace bts { namespace network {
+
+  /**
+   *  Counters used to judge how effective the message buffer pool is, hit_rate()
+   *  close to 1 means almost no message payloads are being allocated.
+   */
+  struct buffer_pool_stats
+  {
+     buffer_pool_stats():hits(0),misses(0),released(0),discarded(0),pooled_bytes(0){}
+
+     double hit_rate()const { return hits + misses ? double(hits) / (hits + misses) : 0; }
+
+     uint64_t hits;         ///< acquire() calls served from the pool
+     uint64_t misses;       ///< acquire() calls that had to allocate
+     uint64_t released;     ///< buffers returned to the pool
+     uint64_t discarded;    ///< buffers freed because they were too large or the pool was full
+     uint64_t pooled_bytes; ///< capacity currently held by the pool
+  };
+
+  /**
+   *  Recycles the storage of incoming message payloads.  Buffers are grouped in
+   *  power of two size classes from 256 bytes to 16 MB and the total capacity 
+   *  kept idle is bounded by NETWORK_BUFFER_POOL_SIZE.  Shared by every 
+   *  connection in the process and safe to use from any thread.
+   */
+  class message_buffer_pool
+  {
+     public:
+        message_buffer_pool( uint64_t max_pooled_bytes );
+
+        static message_buffer_pool& instance();
+
+        /**
+         *  @return a buffer of exactly size bytes whose capacity comes from the
+         *          smallest size class that fits it.
+         */
+        std::vector<char> acquire( size_t size );
+
+        /**
+         *  Returns the storage of buf to the pool or frees it, callers should
+         *  std::move() the payload of a message that is no longer referenced.
+         */
+        void              release( std::vector<char> buf );
+
+        buffer_pool_stats get_stats()const;
+
+     private:
+        enum size_class_limits
+        {
+           min_class_bits = 8,
+           max_class_bits = 24,
+           class_count    = max_class_bits - min_class_bits + 1
+        };
+
+        mutable std::mutex                                      _lock;
+        uint64_t                                                _max_pooled_bytes;
+        buffer_pool_stats                                       _stats;
+        std::array<std::vector<std::vector<char> >,class_count> _free;
+  };
+
+} } // bts::network
+
+FC_REFLECT( bts::network::buffer_pool_stats, (hits)(misses)(released)(discarded)(pooled_bytes) )
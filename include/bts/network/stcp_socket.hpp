@@ -2,12 +2,16 @@
 #include <fc/network/tcp_socket.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
+#include <vector>
 
 namespace bts {  namespace network {
 
 /**
  *  Uses ECDH to negotiate a blowfish key for communicating
  *  with other nodes on the network.
+ *
+ *  The handshake yields to other tasks while crypto_pool computes the shared 
+ *  secret, reads and writes are encrypted in place on the calling thread.
  */
 class stcp_socket : public virtual fc::iostream
 {
@@ -35,6 +39,7 @@ class stcp_socket : public virtual fc::iostream
     fc::tcp_socket       _sock;
     fc::aes_encoder      _send_aes;
     fc::aes_decoder      _recv_aes;
+    std::vector<char>    _crypt_buf; ///< cipher text of the current write
 };
 
 typedef std::shared_ptr<stcp_socket> stcp_socket_ptr;
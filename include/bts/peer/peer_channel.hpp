@@ -5,6 +5,7 @@
 #include <bts/network/server.hpp>
 #include <bts/network/server.hpp>
 #include <bts/peer/peer_host.hpp>
+#include <bts/peer/peer_db.hpp>
 
 namespace bts { namespace peer {
 
@@ -38,10 +39,20 @@ namespace bts { namespace peer {
          *  broadcasts the new channel subscription to all connected nodes. If less than
          *  the minimum number of connections exist to this channel, new connections are
          *  opened.
+         *
+         *  @param compress codec used for large messages on chan when sent to peers
+         *         that advertise support for it in their config_msg.
          */
-        void subscribe_to_channel( const network::channel_id& chan, const network::channel_ptr& c );
+        void subscribe_to_channel( const network::channel_id& chan, const network::channel_ptr& c,
+                                   network::compression_type compress = network::no_compression );
         void unsubscribe_from_channel( const network::channel_id& chan );
 
+        /**
+         *  Hosts learned from other nodes, the channels they subscribe to and how much 
+         *  data they send us are recorded in db.
+         */
+        void set_peer_db( const peer_db_ptr& db );
+
         /**
          *  @return a list of all known hosts.
          */
@@ -1,10 +1,38 @@
 #pragma once
 #include <bts/peer/peer_host.hpp>
+#include <fc/filesystem.hpp>
+#include <memory>
 
 namespace bts { namespace peer {
 
   using network::channel_id;
 
+  namespace detail { class peer_db_impl; }
+
+  /**
+   *  What we have learned about a host from connecting to it, kept separate
+   *  from host because host is relayed to other nodes.
+   */
+  struct host_record
+  {
+     host_record():handshake_rtt_us(0),bytes_received(0),connect_count(0),failure_count(0){}
+
+     /**
+      *  @return a positive score, higher is better, or 0 if the host failed recently
+      *          and should not be retried before its back off expires.
+      */
+     double score( const fc::time_point& now )const;
+
+     /** the part of score() that does not depend on the time, score() never exceeds it */
+     double quality()const;
+
+     host               info;
+     int64_t            handshake_rtt_us;  ///< time to connect and exchange keys, 0 if never connected
+     uint64_t           bytes_received;    ///< total bytes the host has sent us
+     uint32_t           connect_count;     ///< successful connections
+     uint32_t           failure_count;     ///< connection attempts that failed since the last success
+     fc::time_point_sec last_attempt;
+  };
 
   /**
    *  Maintains a database of peers indexed by age, channels, and features. This
@@ -28,8 +56,15 @@ namespace bts { namespace peer {
        */
       void                reset_ages( const fc::time_point_sec& s );
 
+      /**
+       *  Adds r or merges its channels into the existing record.  r.last_com is 
+       *  set by whoever relayed r and is ignored, new hosts are stamped with the 
+       *  time we first heard of them and only our own contact with a host 
+       *  advances it.  When the db is full the lowest scoring host makes room, 
+       *  unless it scores better than r.
+       */
       void                store( const host& r );
-      host                fetch_record( const fc::ip::endpoint& ep );
+      host_record         fetch_record( const fc::ip::endpoint& ep );
 
       /**  Removes a host from the DB, presumably because we attempted to connect 
        * to it and were unable to.  
@@ -43,6 +78,15 @@ namespace bts { namespace peer {
       void                add_channel( const fc::ip::endpoint& e, const channel_id& c );
       void                remove_channel( const fc::ip::endpoint& e, const channel_id& c );
 
+      /** records a successful outgoing connection and how long the handshake took */
+      void                record_connected( const fc::ip::endpoint& ep, const fc::microseconds& handshake_rtt );
+      void                record_failure( const fc::ip::endpoint& ep );
+      void                record_bytes_received( const fc::ip::endpoint& ep, uint64_t bytes );
+
+      /**
+       *  @return up to limit hosts subscribed to c ordered by host_record::score(), 
+       *          every host is assumed to be on the peer channel.
+       */
       std::vector<host>   fetch_hosts( const channel_id& c, uint32_t limit = 10 );
       void                purge_old( const fc::time_point& age );
 
@@ -51,6 +95,8 @@ namespace bts { namespace peer {
 
   }; // peer_db
 
+  typedef std::shared_ptr<peer_db> peer_db_ptr;
+
 } }  // bts::peer
 
-FC_REFLECT( bts::peer::host, (ep)(last_com)(first_com)(channels)(features) )
+FC_REFLECT( bts::peer::host_record, (info)(handshake_rtt_us)(bytes_received)(connect_count)(failure_count)(last_attempt) )
@@ -23,6 +23,9 @@ namespace bts { namespace peer {
      get_announce    = 10,
   };
 
+  /** supported_features entry of nodes that accept zlib compressed messages */
+  #define PEER_FEATURE_ZLIB_COMPRESSION "zlib"
+
   struct config_msg
   {
       static const message_code type;
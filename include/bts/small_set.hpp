@@ -0,0 +1,105 @@
+#pragma once
+#include <fc/variant.hpp>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+namespace bts
+{
+  /**
+   *  A set of at most a handful of items that lives on the stack.  The first N
+   *  items are stored inline and lookups are linear, only sets that grow beyond
+   *  N items allocate.  Items are kept in insertion order.
+   */
+  template<typename T, size_t N>
+  class small_set
+  {
+     public:
+        typedef const T* const_iterator;
+        typedef const T* iterator;
+
+        small_set():_size(0){}
+
+        template<typename Iterator>
+        small_set( Iterator first, Iterator last )
+        :_size(0)
+        {
+           insert( first, last );
+        }
+
+        std::pair<const_iterator,bool> insert( const T& item )
+        {
+           auto itr = find( item );
+           if( itr != end() )
+           {
+              return std::make_pair( itr, false );
+           }
+           if( _size < N )
+           {
+              _inline[_size] = item;
+           }
+           else
+           {
+              if( _size == N ) // spill the inline items
+              {
+                 _overflow.reserve( 2*N );
+                 _overflow.assign( _inline.begin(), _inline.end() );
+              }
+              _overflow.push_back( item );
+           }
+           ++_size;
+           return std::make_pair( end() - 1, true );
+        }
+
+        template<typename Iterator>
+        void insert( Iterator first, Iterator last )
+        {
+           for( ; first != last; ++first )
+           {
+              insert( *first );
+           }
+        }
+
+        const_iterator find( const T& item )const
+        {
+           return std::find( begin(), end(), item );
+        }
+
+        size_t count( const T& item )const { return find( item ) != end(); }
+
+        const_iterator begin()const { return _size > N ? _overflow.data() : _inline.data(); }
+        const_iterator end()const   { return begin() + _size;                               }
+
+        size_t size()const  { return _size;      }
+        bool   empty()const { return _size == 0; }
+
+        void clear()
+        {
+           _size = 0;
+           _overflow.clear();
+        }
+
+     private:
+        size_t              _size;
+        std::array<T,N>     _inline;
+        std::vector<T>      _overflow;
+  };
+
+} // namespace bts
+
+namespace fc
+{
+  template<typename T, size_t N>
+  void to_variant( const bts::small_set<T,N>& s, variant& v )
+  {
+     v = std::vector<T>( s.begin(), s.end() );
+  }
+
+  template<typename T, size_t N>
+  void from_variant( const variant& v, bts::small_set<T,N>& s )
+  {
+     auto items = v.as< std::vector<T> >();
+     s.clear();
+     s.insert( items.begin(), items.end() );
+  }
+}
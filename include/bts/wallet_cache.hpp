@@ -70,6 +70,12 @@ namespace bts  {
         */
        void rescan_chain();
 
+       /**
+        *  Indexes all blocks added to the chain since the last call to 
+        *  rescan_chain() or index_new_blocks().
+        */
+       void index_new_blocks();
+
        /**
         *  Add all trx keys from the last known trx num, and all address up to
         *  adr_limit to the address index to quickly identify outputs that are
@@ -86,14 +92,28 @@ namespace bts  {
         *  This method will scan the trx for inputs/outputs
         *  that belong to this wallet and update the indexes 
         *  accordingly.
+        *
+        *  @param num - location of trx in the chain, only confirmed transactions
+        *               are added to the address history.
         */
-       void  cache( const blockchain::signed_transaction& trx );
+       void  cache( const blockchain::signed_transaction& trx, 
+                    const blockchain::trx_num& num = blockchain::trx_num() );
 
        /**
         *  Calculates the balance available to this wallet type.
         */
        blockchain::asset get_balance( blockchain::asset::type unit )const;
 
+       /**
+        *  @return the ids of all confirmed transactions with an input or output 
+        *          that references addr, in chain order.
+        */
+       std::vector<blockchain::transaction_id_type> get_address_history( const bts::address& addr );
+       std::vector<blockchain::signed_transaction>  get_address_transactions( const bts::address& addr );
+
+       /** @return true if addr has been derived from one of the accounts in this cache */
+       bool is_my_address( const bts::address& addr );
+
        // TODO: add method for creating a new transaction that would
        // spend some of the available balance.
 
@@ -62,6 +62,8 @@ namespace mail {
         fc::ip::endpoint remote_endpoint()const;
         
         void send( const message& m );
+        /** writes a frame built once by pack_message(), used to share one copy between connections */
+        void send( const packed_message& m );
    
         void connect( const std::string& host_port );  
         void connect( const fc::ip::endpoint& ep );
@@ -4,6 +4,8 @@
 #include <fc/io/varint.hpp>
 #include <fc/network/ip.hpp>
 #include <fc/io/raw.hpp>
+#include <memory>
+#include <string.h>
 
 namespace mail {
 
@@ -79,6 +81,25 @@ namespace mail {
      }
   };
 
+  /**
+   *  The header and data of a message padded to a multiple of 16 bytes, exactly
+   *  as it is written to a connection.  Immutable so that a broadcast can share
+   *  one copy between every connection.
+   */
+  typedef std::shared_ptr<const std::vector<char> > packed_message;
+
+  inline packed_message pack_message( const message& m )
+  {
+     size_t len = MAIL_PACKED_MESSAGE_HEADER + m.size;
+     len = 16*((len+15)/16); //pad the message we send to a multiple of 16 bytes
+     auto frame = std::make_shared<std::vector<char> >(len);
+     memcpy( frame->data(), (char*)&m, MAIL_PACKED_MESSAGE_HEADER );
+     if( m.size )
+     {
+        memcpy( frame->data() + MAIL_PACKED_MESSAGE_HEADER, m.data.data(), m.size );
+     }
+     return frame;
+  }
 
  } // mail
 
@@ -49,6 +49,8 @@ namespace unity
         bool             knows_blob( const fc::ripemd160& blob_id );
         
         void send( const message& m );
+        /** writes a frame built once by pack_message(), used to share one copy between connections */
+        void send( const packed_message& m );
    
         void connect( const std::string& host_port );  
         void connect( const fc::ip::endpoint& ep );
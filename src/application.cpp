@@ -6,6 +6,7 @@
 #include <bts/network/upnp.hpp>
 #include <bts/network/ipecho.hpp>
 #include <bts/rpc/rpc_server.hpp>
+#include <bts/peer/peer_db.hpp>
 #include <bts/blockchain/blockchain_client.hpp>
 
 #include <fc/reflect/variant.hpp>
@@ -17,6 +18,7 @@
 
 #include <mail/mail_connection.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -49,6 +51,7 @@ namespace bts {
 
           bts::network::server_ptr          _server;
           bts::peer::peer_channel_ptr       _peers;
+          bts::peer::peer_db_ptr            _peer_db;
           bts::bitname::client_ptr          _bitname_client;
           bts::bitchat::client_ptr          _bitchat_client;     
       //    bts::blockchain::client_ptr         _blockchain_client;     
@@ -103,28 +106,72 @@ namespace bts {
                 fc::usleep( fc::seconds(3) );
              }
           }
+          /**
+           *  Keeps DESIRED_PEER_COUNT connections open, dialing the best scoring hosts 
+           *  in the peer db (which includes the default nodes) in parallel so that a 
+           *  node fills its peer set within a few handshakes.
+           */
           void connect_loop()
           {
              assert(!!_config );
              while( !_quit_promise->ready() )
              {
-                for( auto itr = _config->default_nodes.begin();
-                    _quit_promise->ready() == false && itr != _config->default_nodes.end(); ++itr )
+                bool attempted = false;
+                auto cons = _server->get_connections();
+                if( cons.size() < DESIRED_PEER_COUNT )
                 {
-                     try {
-                        ilog( "${e}", ("e",*itr) );
-                        _server->connect_to(*itr);
-                     } 
-                     catch ( const fc::exception& e )
-                     {
-                        wlog( "${e}", ("e",e.to_detail_string()));
-                     }
+                   std::vector<fc::ip::endpoint> connected;
+                   for( auto itr = cons.begin(); itr != cons.end(); ++itr )
+                   {
+                      connected.push_back( (*itr)->remote_endpoint() );
+                   }
+
+                   auto candidates = _peer_db->fetch_hosts( network::channel_id( network::peer_proto ), 2*DESIRED_PEER_COUNT );
+                   std::vector<fc::future<void> > attempts;
+                   for( auto itr = candidates.begin(); 
+                        itr != candidates.end() && attempts.size() < DESIRED_PEER_COUNT - cons.size(); ++itr )
+                   {
+                      if( std::find( connected.begin(), connected.end(), itr->ep ) != connected.end() )
+                      {
+                         continue;
+                      }
+                      auto ep = itr->ep;
+                      attempts.push_back( fc::async( [=](){ connect_to_host( ep ); } ) );
+                   }
+                   attempted = attempts.size() != 0;
+                   for( auto itr = attempts.begin(); itr != attempts.end(); ++itr )
+                   {
+                      itr->wait();
+                   }
                 }
 
                 if(_quit_promise->ready())
                   break;
 
-                fc::usleep( fc::seconds(3) );
+                // keep dialing quickly while there are untried candidates
+                if( attempted && _server->get_connections().size() < DESIRED_PEER_COUNT )
+                {
+                   fc::usleep( fc::milliseconds(250) );
+                }
+                else
+                {
+                   fc::usleep( fc::seconds(PEER_CONNECT_INTERVAL_SEC) );
+                }
+             }
+          }
+
+          void connect_to_host( const fc::ip::endpoint& ep )
+          {
+             auto start = fc::time_point::now();
+             try {
+                ilog( "${e}", ("e",ep) );
+                _server->connect_to( ep );
+                _peer_db->record_connected( ep, fc::time_point::now() - start );
+             } 
+             catch ( const fc::exception& e )
+             {
+                wlog( "${e}", ("e",e.to_detail_string()));
+                _peer_db->record_failure( ep );
              }
           }
 
@@ -336,8 +383,18 @@ namespace bts {
 
     _server->configure( server_cfg );
 
+    ilog("opening peer db");
+    _peer_db = std::make_shared<bts::peer::peer_db>();
+    _peer_db->open( cfg.data_dir / "peers" );
+    _peer_db->purge_old( fc::time_point::now() - fc::seconds( PEER_DB_MAX_AGE_SEC ) );
+    for( auto itr = cfg.default_nodes.begin(); itr != cfg.default_nodes.end(); ++itr )
+    {
+       _peer_db->store( bts::peer::host( *itr, network::channel_id( network::peer_proto ) ) );
+    }
+
     ilog("configure bitname client");
     _peers            = std::make_shared<bts::peer::peer_channel>(_server);
+    _peers->set_peer_db( _peer_db );
     _bitname_client   = std::make_shared<bts::bitname::client>(_peers);
     _bitname_client->set_delegate(this);
 
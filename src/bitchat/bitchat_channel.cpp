@@ -2,6 +2,8 @@
 #include <bts/bitchat/bitchat_messages.hpp>
 #include <bts/bitchat/bitchat_private_message.hpp>
 #include <bts/bitchat/bitchat_message_cache.hpp>
+#include <bts/network/inventory_scheduler.hpp>
+#include <bts/config.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/log/logger.hpp>
@@ -46,7 +48,7 @@ namespace bts { namespace bitchat {
                                                              
           std::vector<fc::uint128>                           new_msgs;  // messages received since last inv broadcast
                                                              
-          fc::future<void>                                   fetch_loop_complete;
+          network::inventory_scheduler                       fetch_scheduler;
 
           /**
            *  Get or create the bitchat channel data for this connection and return
@@ -116,6 +118,7 @@ namespace bts { namespace bitchat {
                      // message.
                      wlog( "unknown bitchat message type ${t}", ("t",uint64_t(m.msg_type)) );
               }
+              fetch_scheduler.notify();
           }
 
           void handle_cache_inv( const connection_ptr& c, chan_data& cdat, cache_inv_message msg )
@@ -143,32 +146,23 @@ namespace bts { namespace bitchat {
               c->send( network::message( reply, chan_id ) ); 
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) }
 
-          void fetch_loop()
+          /**
+           *  Broadcasts new inventory and requests unknown messages, runs whenever a
+           *  message is received or broadcast instead of polling.
+           */
+          void fetch_next()
           {
-             try {
-                while( !fetch_loop_complete.canceled() )
+             broadcast_inv();
+             if( unknown_msgs.size()  )
+             {
+                auto cons = peers->get_connections( chan_id );
+                // copy so we don't hold shared state in the iterators
+                // while we iterate and send fetch requests
+                auto tmp = unknown_msgs; 
+                for( auto itr = tmp.begin(); itr != tmp.end(); ++itr )
                 {
-                   broadcast_inv();
-                   if( unknown_msgs.size()  )
-                   {
-                      auto cons = peers->get_connections( chan_id );
-                      // copy so we don't hold shared state in the iterators
-                      // while we iterate and send fetch requests
-                      auto tmp = unknown_msgs; 
-                      for( auto itr = tmp.begin(); itr != tmp.end(); ++itr )
-                      {
-                          fetch_from_best_connection( cons, *itr );
-                      }
-                   }
-                   /* By using a random sleep we give other peers the oppotunity to find
-                    * out about messages before we pick who to fetch from.
-                    */
-                   fc::usleep( fc::microseconds( (rand() % 20000) + 100) ); // note: usleep(0) sleeps forever... perhaps a bug?
+                    fetch_from_best_connection( cons, *itr );
                 }
-             } 
-             catch ( const fc::exception& e )
-             {
-               wlog( "${e}", ("e", e.to_detail_string()) );
              }
           }
 
@@ -198,14 +192,19 @@ namespace bts { namespace bitchat {
           /**
            *  Send any new inventory items that we have received since the last
            *  broadcast to all connections that do not know about the inv item.
+           *  Congested connections are deferred, new_msgs is kept and another 
+           *  broadcast is scheduled.  known_inv keeps the items from being sent
+           *  twice to the connections that were not congested.
            */
           void broadcast_inv()
           {
               if( new_msgs.size() )
               {
+                bool deferred = false;
                 auto cons = peers->get_connections( chan_id );
                 for( auto c = cons.begin(); c != cons.end(); ++c )
                 {
+                  if( (*c)->is_congested() ) { deferred = true; continue; }
                   inv_message msg;
 
                   chan_data& cd = get_channel_data( *c );
@@ -222,7 +221,14 @@ namespace bts { namespace bitchat {
                     (*c)->send( network::message(msg,chan_id) );
                   }
                 }
-                new_msgs.clear();
+                if( deferred )
+                {
+                   fetch_scheduler.notify_at( fc::time_point::now() + fc::milliseconds( NETWORK_CONGESTED_RETRY_MS ) );
+                }
+                else
+                {
+                   new_msgs.clear();
+                }
               }
           }
 
@@ -336,7 +342,9 @@ namespace bts { namespace bitchat {
 
      my->peers->subscribe_to_channel( c, my );
 
-     my->fetch_loop_complete = fc::async( [=](){ my->fetch_loop(); } );
+     // the scheduler is owned by the impl, a shared_ptr to it would form a cycle
+     auto self = my.get();
+     my->fetch_scheduler.start( [self](){ self->fetch_next(); } );
   }
 
   channel::~channel()
@@ -344,8 +352,7 @@ namespace bts { namespace bitchat {
      my->peers->unsubscribe_from_channel( my->chan_id );
      my->del = nullptr;
      try {
-        my->fetch_loop_complete.cancel();
-        my->fetch_loop_complete.wait();
+        my->fetch_scheduler.stop();
      } 
      catch ( ... ) 
      {
@@ -372,6 +379,7 @@ namespace bts { namespace bitchat {
       my->priv_msgs[ id ] = std::move(m);
       my->msg_time_index[ m.timestamp ] = id;
       my->new_msgs.push_back(id);
+      my->fetch_scheduler.notify();
   }
 
   void channel::configure( const channel_config& conf )
@@ -11,6 +11,7 @@
 #include <bts/network/server.hpp>
 #include <bts/network/channel.hpp>
 #include <bts/network/broadcast_manager.hpp>
+#include <bts/network/inventory_scheduler.hpp>
 #include <bts/difficulty.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/crypto/hex.hpp>
@@ -85,7 +86,7 @@ namespace bts { namespace bitname {
           fork_db                                           _fork_db;
 
           fetch_loop_state                                  _fetch_state;                          
-          fc::future<void>                                  _fetch_loop;
+          inventory_scheduler                               _fetch_scheduler;
            
            // TODO: on connection disconnect, check to see if there was a pending fetch and
            // cancel it so we can get it from someone else.
@@ -165,12 +166,17 @@ namespace bts { namespace bitname {
              }
           }
 
-          void fetch_next_from_fork_db()
+          /**
+           *  Applies the next block of the best fork or requests it if we do not have it yet.
+           *
+           *  @return true if a block was applied (or found invalid) and there may be more to apply
+           */
+          bool fetch_next_from_fork_db()
           { try {
               if( _pending_block_fetch && 
                  (fc::time_point::now() - *_pending_block_fetch) < fc::seconds( BITNAME_BLOCK_FETCH_TIMEOUT_SEC ) )
               {
-                 return;
+                 return false;
               }
               if( _new_block_info )
               {
@@ -179,7 +185,7 @@ namespace bts { namespace bitname {
                   //ilog( "valid_head_num: ${v}", ("v",valid_head_num) ); 
                   if( valid_head_num >= _fork_db.best_fork_height() )
                   {
-                     return;
+                     return false;
                   }
                   meta_header next_best = _fork_db.best_fork_fetch_at( valid_head_num + 1);
                   //ilog( "next_best: ${v}", ("v",next_best) ); 
@@ -205,6 +211,7 @@ namespace bts { namespace bitname {
                          _fork_db.set_valid( next_block->id(), false );
                      }
                      _new_block_info = true; // attempt another block on next call
+                     return true;
                   }
                   else
                   {
@@ -215,6 +222,7 @@ namespace bts { namespace bitname {
                      }
                   }
               }
+              return false;
           } FC_RETHROW_EXCEPTIONS( warn , "" ) }
 
           /**
@@ -232,51 +240,38 @@ namespace bts { namespace bitname {
            *  a potential chain reorganization though this should be relatively
            *  rare.
            *  
+           *  Runs whenever a message is received or a name or block is submitted, and
+           *  when the pending block request times out.
            */
-          void fetch_loop()
+          void fetch_next()
           {
-             try 
-             {
-                while( !_fetch_loop.canceled() )
-                {
-                   broadcast_inv();
-
-                   fetch_next_from_fork_db();
-                   
-                   short_name_id_type trx_query = 0;
-                   if( _trx_broadcast_mgr.find_next_query( trx_query ) )
-                   {
-                      auto cons = _peers->get_connections( _chan_id );
-                      fetch_name_from_best_connection( cons, trx_query );
-                      _trx_broadcast_mgr.item_queried( trx_query );
-                   }
-                   
-                   name_id_type blk_idx_query;
-                   if( _block_index_broadcast_mgr.find_next_query( blk_idx_query ) )
-                   {
-                      auto cons = _peers->get_connections( _chan_id );
-                      fetch_block_idx_from_best_connection( cons, blk_idx_query );
-                      _block_index_broadcast_mgr.item_queried( blk_idx_query );
-                   }
+             broadcast_inv();
 
+             bool applied_block = fetch_next_from_fork_db();
+             
+             short_name_id_type trx_query = 0;
+             while( _trx_broadcast_mgr.find_next_query( trx_query ) )
+             {
+                auto cons = _peers->get_connections( _chan_id );
+                fetch_name_from_best_connection( cons, trx_query );
+                _trx_broadcast_mgr.item_queried( trx_query );
+             }
+             
+             name_id_type blk_idx_query;
+             while( _block_index_broadcast_mgr.find_next_query( blk_idx_query ) )
+             {
+                auto cons = _peers->get_connections( _chan_id );
+                fetch_block_idx_from_best_connection( cons, blk_idx_query );
+                _block_index_broadcast_mgr.item_queried( blk_idx_query );
+             }
 
-                   /* By using a random sleep we give other peers the oppotunity to find
-                    * out about messages before we pick who to fetch from.
-                    * TODO: move constants to config.hpp
-                    *
-                    * TODO: fetch set your fetch order based upon how many times we have received
-                    *        an inv regarding a particular item.
-                    *
-                    * TODO: make sure we seed rand()
-                    */
-                   fc::usleep( fc::microseconds( (rand() % 20000) + 100) );
-                }
-             } 
-             catch ( const fc::exception& e )
+             if( applied_block )
+             {
+                _fetch_scheduler.notify(); // fetch_next_from_fork_db() may have more blocks to apply
+             }
+             else if( _pending_block_fetch )
              {
-               elog( "fetch loop threw... something bad happened\n${e}", ("e", e.to_detail_string()) );
-               // TODO: bitname will hang if we don't find some way to recover or report this
-               // to the user...
+                _fetch_scheduler.notify_at( *_pending_block_fetch + fc::seconds( BITNAME_BLOCK_FETCH_TIMEOUT_SEC ) );
              }
           }
 
@@ -293,6 +288,8 @@ namespace bts { namespace bitname {
           /**
            *  Send any new inventory items that we have received since the last
            *  broadcast to all connections that do not know about the inv item.
+           *  Congested connections are deferred, their broadcast managers keep 
+           *  the items and another broadcast is scheduled.
            */
           void broadcast_inv()
           { try {
@@ -301,8 +298,10 @@ namespace bts { namespace bitname {
                  auto cons = _peers->get_connections( _chan_id );
                  if( _trx_broadcast_mgr.has_new_since_broadcast() )
                  {
+                   bool deferred = false;
                    for( auto c = cons.begin(); c != cons.end(); ++c )
                    {
+                     if( (*c)->is_congested() ) { deferred = true; continue; }
                      name_inv_message inv_msg;
                  
                      chan_data& con_data = get_channel_data( *c );
@@ -314,13 +313,15 @@ namespace bts { namespace bitname {
                        con_data.trxs_mgr.update_known( inv_msg.name_trxs );
                      }
                    }
-                   _trx_broadcast_mgr.set_new_since_broadcast(false);
+                   _trx_broadcast_mgr.set_new_since_broadcast(deferred);
                  }
                  
                  if( _block_index_broadcast_mgr.has_new_since_broadcast() )
                  {
+                   bool deferred = false;
                    for( auto c = cons.begin(); c != cons.end(); ++c )
                    {
+                     if( (*c)->is_congested() ) { deferred = true; continue; }
                      block_inv_message inv_msg;
                  
                      chan_data& con_data = get_channel_data( *c );
@@ -332,7 +333,12 @@ namespace bts { namespace bitname {
                        con_data.block_mgr.update_known( inv_msg.block_ids );
                      }
                    }
-                   _block_index_broadcast_mgr.set_new_since_broadcast(false);
+                   _block_index_broadcast_mgr.set_new_since_broadcast(deferred);
+                 }
+
+                 if( _trx_broadcast_mgr.has_new_since_broadcast() || _block_index_broadcast_mgr.has_new_since_broadcast() )
+                 {
+                    _fetch_scheduler.notify_at( fc::time_point::now() + fc::milliseconds( NETWORK_CONGESTED_RETRY_MS ) );
                  }
              }
           } FC_RETHROW_EXCEPTIONS( warn, "error broadcasting bitname inventory") } // broadcast_inv
@@ -484,6 +490,7 @@ namespace bts { namespace bitname {
                  default:
                    FC_THROW_EXCEPTION( fc::exception, "unknown bitname message type ${msg_type}", ("msg_type", m.msg_type ) );
              }
+             _fetch_scheduler.notify();
             } 
             catch ( fc::exception& e )
             {
@@ -763,6 +770,7 @@ namespace bts { namespace bitname {
           { try {
              _name_db.validate_trx( new_name_trx );
              _trx_broadcast_mgr.validated( new_name_trx.short_id(), new_name_trx, true );
+             _fetch_scheduler.notify();
              if( _delegate )
              {
                try {
@@ -782,6 +790,7 @@ namespace bts { namespace bitname {
           { try {
              _fork_db.cache_block( block );
              _new_block_info = true;
+             _fetch_scheduler.notify();
              _name_db.push_block( block ); // this throws on error
              _name_db.dump(); // DEBUG
 
@@ -801,7 +810,7 @@ namespace bts { namespace bitname {
   {
      my->_peers = n;
      my->_chan_id = channel_id(network::name_proto,0);
-     my->_peers->subscribe_to_channel( my->_chan_id, my );
+     my->_peers->subscribe_to_channel( my->_chan_id, my, network::zlib_compression );
   }
 
   name_channel::~name_channel() 
@@ -809,11 +818,7 @@ namespace bts { namespace bitname {
      my->_peers->unsubscribe_from_channel( my->_chan_id );
      my->_delegate = nullptr;
      try {
-        if( my->_fetch_loop.valid() )
-        {
-            my->_fetch_loop.cancel();
-            my->_fetch_loop.wait();
-        }
+        my->_fetch_scheduler.stop();
      } 
      catch ( ... ) 
      {
@@ -828,7 +833,9 @@ namespace bts { namespace bitname {
       my->_name_db.open( c.name_db_dir, true/*create*/ );
       my->_fork_db.open( c.name_db_dir / "forks" , true/*create*/ );
 
-      my->_fetch_loop = fc::async( [=](){ my->fetch_loop(); } );
+      // the scheduler is owned by the impl, a shared_ptr to it would form a cycle
+      auto self = my.get();
+      my->_fetch_scheduler.start( [self](){ self->fetch_next(); } );
       // TODO: connect to the network and attempt to download the chain...
       //      *  what if no peers on on the name channel ??  * 
       //         I guess when I do connect to a peer on this channel they will
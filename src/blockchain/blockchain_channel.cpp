@@ -1,9 +1,14 @@
 #include <bts/blockchain/blockchain_channel.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/blockchain/blockchain_messages.hpp>
+#include <bts/config.hpp>
+#include <bts/difficulty.hpp>
+#include <bts/network/inventory_scheduler.hpp>
 
 #include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/uint128.hpp>
 
 #include <map>
 
@@ -21,6 +26,13 @@ namespace bts { namespace blockchain {
      class chan_data : public network::channel_data
      {
         public:
+          chan_data():best_header_num(INVALID_BLOCK_NUM),pruned_through(INVALID_BLOCK_NUM){}
+
+          /** the highest block this connection has sent us a header for */
+          uint32_t                          best_header_num;
+          /** the highest block this connection told us it no longer has */
+          uint32_t                          pruned_through;
+
           std::unordered_set<uint160>        known_trx_inv;
           std::unordered_set<block_id_type>  known_block_inv;
 
@@ -45,6 +57,39 @@ namespace bts { namespace blockchain {
         std::unordered_map<uint160,uint16_t>  missing_trx_idx;
         full_block                            full_blk;
         std::vector<signed_transaction>       trxs;
+        fc::time_point                        started;
+     };
+
+     /**
+      *  A block requested from a connection while syncing
+      */
+     struct sync_request
+     {
+        connection_ptr    con;
+        block_id_type     block_id;
+        fc::time_point    requested;
+     };
+
+     /**
+      *  Headers first sync, the header chain is downloaded first and then a window of
+      *  blocks past our head is requested from every connection that has them.  Blocks
+      *  that arrive out of order are buffered until they can be pushed in order.
+      */
+     struct block_sync_state
+     {
+        /** header chain past our head block, indexed by block number */
+        std::map<uint32_t,std::pair<block_header,block_id_type> >  headers;
+        std::map<uint32_t,sync_request>                            in_flight;
+        std::map<uint32_t,trx_block>                               buffered;
+        /** blocks that failed to push, header chains containing them are rejected, survives clear() */
+        std::unordered_set<block_id_type>                          invalid;
+
+        void clear()
+        {
+           headers.clear();
+           in_flight.clear();
+           buffered.clear();
+        }
      };
 
      class channel_impl  : public bts::network::channel
@@ -81,6 +126,13 @@ namespace bts { namespace blockchain {
 
           std::vector<signed_transaction>                  _verify_queue;
 
+          block_sync_state                                 _sync;
+          /** the assume valid checkpoint whose ancestors have been passed to the db */
+          block_id_type                                    _assume_valid_marked;
+          /** the only block 0 accepted from peers while our database is empty */
+          fc::optional<block_id_type>                      _genesis_id;
+          network::inventory_scheduler                     _sync_timeouts;
+
           chan_data& get_channel_data( const connection_ptr& c )
           {
               auto cd = c->get_channel_data( _chan_id );
@@ -95,19 +147,113 @@ namespace bts { namespace blockchain {
           
           void attempt_push_download_block()
           { try {
-              _db->push_block( trx_block( _block_download.full_blk, std::move( _block_download.trxs) ) );
+              trx_block blk( _block_download.full_blk, std::move( _block_download.trxs) );
+              _block_download = block_download_state();
+              if( blk.prev != _db->head_block_id() )
+              {
+                 wlog( "dropping downloaded block ${block_num}, our head block changed while it was fetched", 
+                       ("block_num",blk.block_num) );
+                 return;
+              }
+
+              // push_block verifies that the reconstructed trxs match the merkle root
+              _db->push_block( blk );
+              if( _del ) _del->handle_trx_block( blk );
+              on_block_pushed( blk );
           } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+          /**
+           *  Rebuilds the trx_block announced by blk from the pending pool and requests
+           *  any trxs that we do not have from c.
+           */
+          void start_block_download( const connection_ptr& c, chan_data& cdat, const full_block& blk )
+          { try {
+              FC_ASSERT( blk.trx_mroot == blk.calculate_merkle_root(), "trx ids do not match the merkle root" );
+
+              _block_download          = block_download_state();
+              _block_download.full_blk = blk;
+              _block_download.started  = fc::time_point::now();
+              _block_download.trxs.resize( blk.trx_ids.size() );
+
+              std::vector<get_trxs_message> requests( 1 );
+              for( uint16_t i = 0; i < blk.trx_ids.size(); ++i )
+              {
+                 auto pending_itr = _pending_trx.find( blk.trx_ids[i] );
+                 if( pending_itr != _pending_trx.end() )
+                 {
+                    _block_download.trxs[i] = pending_itr->second;
+                    continue;
+                 }
+                 _block_download.missing_trx_idx[blk.trx_ids[i]] = i;
+                 cdat.requested_trxs.insert( blk.trx_ids[i] );
+                 if( requests.back().items.size() + 1 >= TRX_INV_QUERY_LIMIT )
+                 {
+                    requests.push_back( get_trxs_message() );
+                 }
+                 requests.back().items.push_back( blk.trx_ids[i] );
+              }
+
+              if( _block_download.missing_trx_idx.size() == 0 )
+              {
+                 attempt_push_download_block();
+                 return;
+              }
+              ilog( "fetching ${n} of ${total} trxs for block ${b}", 
+                    ("n",_block_download.missing_trx_idx.size())("total",blk.trx_ids.size())("b",blk.block_num) );
+              for( auto itr = requests.begin(); itr != requests.end(); ++itr )
+              {
+                 c->send( network::message( *itr, _chan_id ) );
+              }
+          } FC_RETHROW_EXCEPTIONS( warn, "", ("block",blk) ) }
+
+          /**
+           *  Announces blk to every connection that does not already know about it by 
+           *  sending only the header and trx ids.  Congested connections are skipped, they
+           *  sync the block once they announce something past our head.
+           */
+          void announce_block( const full_block& blk )
+          {
+              auto block_id = blk.id();
+              auto msg = network::pack_message( network::message( full_block_message( blk ), _chan_id ) );
+              auto cons = _peers->get_connections( _chan_id );
+              for( auto itr = cons.begin(); itr != cons.end(); ++itr )
+              {
+                 if( (*itr)->is_congested() ) continue;
+                 chan_data& cdat = get_channel_data( *itr );
+                 if( cdat.known_block_inv.insert( block_id ).second )
+                 {
+                    (*itr)->send( msg );
+                 }
+              }
+          }
+
+          void on_block_pushed( const trx_block& blk )
+          {
+              for( auto itr = blk.trxs.begin(); itr != blk.trxs.end(); ++itr )
+              {
+                 _pending_trx.erase( itr->id() );
+              }
+              _recently_invalid_trx.clear();
+              announce_block( blk );
+          }
+
 
           virtual void handle_subscribe( const connection_ptr& c )
           {
               get_channel_data(c); // creates it... 
-          //    request_latest_blocks();
+              request_headers( c );
           }
 
           virtual void handle_unsubscribe( const connection_ptr& c )
           {
+              // hand anything we were syncing from c to the remaining connections
+              for( auto itr = _sync.in_flight.begin(); itr != _sync.in_flight.end(); )
+              {
+                 if( itr->second.con == c ) itr = _sync.in_flight.erase( itr );
+                 else ++itr;
+              }
               c->set_channel_data( _chan_id, nullptr );
+              schedule_sync_downloads();
           }
 
           virtual void handle_message( const connection_ptr& c, const bts::network::message& m )
@@ -158,6 +304,18 @@ namespace bts { namespace blockchain {
                       handle_trx_block( c, cdat, m.as<trx_block_message>() );
                       break;
 
+                  case block_not_available_msg:
+                      handle_block_not_available( c, cdat, m.as<block_not_available_message>() );
+                      break;
+
+                  case get_headers_msg:
+                      handle_get_headers( c, cdat, m.as<get_headers_message>() );
+                      break;
+
+                  case headers_msg:
+                      handle_headers( c, cdat, m.as<headers_message>() );
+                      break;
+
                   default:
                      // TODO: figure out how to document this / punish the connection that sent us this 
                      // message.
@@ -184,7 +342,10 @@ namespace bts { namespace blockchain {
                               ("item", *itr) );
                     // TODO: why is this connection sending things multiple times... punish it
                  }
-                 _trxs_pending_fetch.insert( *itr );
+                 if( _pending_trx.find( *itr ) == _pending_trx.end() && !_db->is_known_trx( *itr ) )
+                 {
+                    _trxs_pending_fetch.insert( *itr );
+                 }
               }
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
@@ -218,7 +379,10 @@ namespace bts { namespace blockchain {
                               ("item", *itr) );
                     // TODO: why is this connection sending things multiple times... punish it
                  }
-                 _blocks_pending_fetch.insert( *itr );
+                 if( !_db->is_known_block( *itr ) )
+                 {
+                    _blocks_pending_fetch.insert( *itr );
+                 }
               }
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
@@ -263,9 +427,9 @@ namespace bts { namespace blockchain {
               // this request must hit the DB... cost in proof of work is proportional to age to prevent
               // cache thrashing attacks and allowing us to keep newer blocks in the cache 
               // penalize connections that request too many full blocks...
-              uint32_t blk_num = _db->fetch_block_num( msg.block_id );
-              full_block blk   = _db->fetch_full_block( blk_num );
-              c->send( network::message(full_block_message( blk ), _chan_id ) );
+              // full_block_message packs identically to the full_block it contains
+              auto packed = _db->fetch_packed_full_block( msg.block_id );
+              c->send( network::message::from_packed<full_block_message>( *packed, _chan_id ) );
 
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
@@ -276,8 +440,13 @@ namespace bts { namespace blockchain {
           { try {
               // TODO: throttle attempts to query blocks by a single connection
               uint32_t blk_num = _db->fetch_block_num( msg.block_id );
-              trx_block blk    = _db->fetch_trx_block( blk_num );
-              c->send( network::message(trx_block_message( blk ), _chan_id ) );
+              if( _db->is_block_pruned( blk_num ) )
+              {
+                 c->send( network::message( block_not_available_message( msg.block_id ), _chan_id ) );
+                 return;
+              }
+              auto packed = _db->fetch_packed_trx_block( msg.block_id );
+              c->send( network::message::from_packed<trx_block_message>( *packed, _chan_id ) );
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
           /**
@@ -293,6 +462,7 @@ namespace bts { namespace blockchain {
                     FC_THROW_EXCEPTION( exception, "unsolicited transaction ${trx_id}", 
                                                     ("trx_id", item_id)("trx", *itr) );
                  }
+                 cdat.requested_trxs.erase( item_id );
                  _verify_queue.push_back( *itr ); 
 
                  // is this trx part of a block download
@@ -304,7 +474,6 @@ namespace bts { namespace blockchain {
                     if( _block_download.missing_trx_idx.size() == 0 )
                     {
                        attempt_push_download_block();
-                       // TODO: attempt to push full block!
                     }
                  }
               }
@@ -316,13 +485,46 @@ namespace bts { namespace blockchain {
           void handle_full_block( const connection_ptr& c, chan_data& cdat, full_block_message msg )
           { try {
               auto block_id = msg.block_data.id();
-              if( cdat.requested_full_block != block_id )
+              cdat.known_block_inv.insert( block_id );
+              if( cdat.requested_full_block == block_id )
+              {
+                  cdat.requested_full_block = block_id_type();
+              }
+              if( _db->is_known_block( block_id ) )
               {
-                  FC_THROW_EXCEPTION( exception, "unsolicited full block ${block_id}", 
-                                      ("block_id", block_id)("block", msg.block_data) );
+                  return;
               }
-              // attempt to create a trx_block by looking up missing transactions
 
+              // unsolicited full blocks are compact announcements of a new head block, blocks
+              // that do not extend our head are left for the sync process.
+              if( msg.block_data.prev != _db->head_block_id() )
+              {
+                  wlog( "ignoring full block ${block_num} that does not extend our head block", 
+                        ("block_num",msg.block_data.block_num) );
+                  if( _db->head_block_num() == INVALID_BLOCK_NUM || msg.block_data.block_num > _db->head_block_num() )
+                  {
+                     request_headers( c ); // we have fallen behind, sync up to the announced block
+                  }
+                  return;
+              }
+
+              // only one download at a time, a competing block at the same height is dropped 
+              // unless the current download has stalled
+              if( _block_download.missing_trx_idx.size() && _block_download.full_blk.prev == _db->head_block_id() )
+              {
+                  if( _block_download.full_blk.id() == block_id )
+                  {
+                     return; // already fetching it from another connection
+                  }
+                  if( fc::time_point::now() - _block_download.started < fc::seconds( BLOCKCHAIN_SYNC_TIMEOUT_SEC ) )
+                  {
+                     wlog( "ignoring block ${block_num} while downloading a competing block", 
+                           ("block_num",msg.block_data.block_num) );
+                     return;
+                  }
+                  wlog( "abandoning stalled download of block ${block_num}", ("block_num",_block_download.full_blk.block_num) );
+              }
+              start_block_download( c, cdat, msg.block_data );
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
           /**
@@ -331,13 +533,429 @@ namespace bts { namespace blockchain {
           void handle_trx_block( const connection_ptr& c, chan_data& cdat, trx_block_message msg )
           { try {
               auto block_id = msg.block_data.id();
+              if( cdat.requested_blocks.erase( block_id ) )
+              {
+                  handle_sync_block( c, std::move( msg.block_data ) );
+                  return;
+              }
               if( cdat.requested_trx_block != block_id )
               {
                   FC_THROW_EXCEPTION( exception, "unsolicited trx block ${block_id}", 
                                                 ("block_id", block_id)("block", msg.block_data) );
               }
+              cdat.requested_trx_block = block_id_type();
               // attempt to push it onto the block db... if successful broadcast a block inv
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
+
+          /**
+           *  The remote node is pruned, clear the request so the block can be fetched 
+           *  from another connection.
+           */
+          void handle_block_not_available( const connection_ptr& c, chan_data& cdat, block_not_available_message msg )
+          { try {
+              if( cdat.requested_blocks.erase( msg.block_id ) )
+              {
+                  for( auto itr = _sync.in_flight.begin(); itr != _sync.in_flight.end(); ++itr )
+                  {
+                     if( itr->second.block_id == msg.block_id )
+                     {
+                        auto block_num = itr->first;
+                        _sync.in_flight.erase( itr );
+                        // c is pruned, it is never asked for this block (or older ones) again
+                        if( cdat.pruned_through == INVALID_BLOCK_NUM || block_num > cdat.pruned_through )
+                        {
+                           cdat.pruned_through = block_num;
+                        }
+                        if( !request_sync_block( block_num, c ) )
+                        {
+                           wlog( "no connection has block ${n}, waiting for new connections", ("n",block_num) );
+                        }
+                        break;
+                     }
+                  }
+                  return;
+              }
+              if( cdat.requested_trx_block != msg.block_id )
+              {
+                  FC_THROW_EXCEPTION( exception, "unsolicited block not available ${block_id}", 
+                                                ("block_id", msg.block_id) );
+              }
+              wlog( "trx block ${block_id} is not available from this connection", ("block_id",msg.block_id) );
+              cdat.requested_trx_block = block_id_type();
+          } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
+
+          /**
+           *  @return ids of the tip of our header chain followed by blocks in our database 
+           *          going back in powers of 2 to the genesis block.
+           */
+          std::vector<block_id_type> get_block_locator()
+          {
+              std::vector<block_id_type> locator;
+              if( _sync.headers.size() )
+              {
+                 locator.push_back( _sync.headers.rbegin()->second.second );
+              }
+              uint32_t head = _db->head_block_num();
+              if( head == INVALID_BLOCK_NUM ) 
+              {
+                 return locator;
+              }
+              for( uint32_t step = 1; ; step *= 2 )
+              {
+                 locator.push_back( _db->fetch_block( head ).id() );
+                 if( head == 0 ) break;
+                 head = head > step ? head - step : 0;
+              }
+              return locator;
+          }
+
+          void request_headers( const connection_ptr& c )
+          {
+              get_headers_message request;
+              request.known = get_block_locator();
+              c->send( network::message( request, _chan_id ) );
+          }
+
+          void handle_get_headers( const connection_ptr& c, chan_data& cdat, get_headers_message msg )
+          { try {
+              // TODO: throttle attempts to query headers by a single connection
+              uint32_t start = 0;
+              for( auto itr = msg.known.begin(); itr != msg.known.end(); ++itr )
+              {
+                 if( _db->is_known_block( *itr ) )
+                 {
+                    start = _db->fetch_block_num( *itr ) + 1;
+                    break;
+                 }
+              }
+
+              headers_message reply;
+              uint32_t head = _db->head_block_num();
+              for( uint32_t num = start; head != INVALID_BLOCK_NUM && num <= head && 
+                                         reply.headers.size() < BLOCK_INV_QUERY_LIMIT; ++num )
+              {
+                 reply.headers.push_back( _db->fetch_block( num ) );
+              }
+              c->send( network::message( reply, _chan_id ) );
+          } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) }
+
+          /**
+           *  Extends (or replaces the tail of) the header chain with msg.headers after 
+           *  checking that they link together and carry the required proof of work.
+           */
+          void handle_headers( const connection_ptr& c, chan_data& cdat, headers_message msg )
+          { try {
+              if( msg.headers.size() == 0 ) 
+              {
+                 return; // nothing newer than what we have
+              }
+              FC_ASSERT( msg.headers.size() <= BLOCK_INV_QUERY_LIMIT );
+
+              const block_header& first = msg.headers.front();
+              uint32_t last_num         = first.block_num + msg.headers.size() - 1;
+              uint32_t head             = _db->head_block_num();
+
+              // the first header must link to a block we have or to our header chain
+              fc::optional<block_header> prev;
+              auto prev_itr = _sync.headers.find( first.block_num - 1 );
+              if( prev_itr != _sync.headers.end() && prev_itr->second.second == first.prev )
+              {
+                 prev = prev_itr->second.first;
+              }
+              else if( first.block_num == 0 )
+              {
+                 // with an empty database anyone could hand us a genesis block of their own
+                 FC_ASSERT( first.prev == block_id_type() );
+                 FC_ASSERT( head != INVALID_BLOCK_NUM || (_genesis_id && first.id() == *_genesis_id), 
+                            "headers do not start at our genesis block", ("id",first.id()) );
+              }
+              else if( _db->is_known_block( first.prev ) )
+              {
+                 FC_ASSERT( _db->fetch_block_num( first.prev ) + 1 == first.block_num );
+                 prev = _db->fetch_block( first.block_num - 1 );
+              }
+              else
+              {
+                 FC_THROW_EXCEPTION( exception, "headers do not link to a known block", ("first",first) );
+              }
+
+              // pop_block cannot reorganize our chain, so headers that branch off below our head are 
+              // rejected rather than stored.  The headers link to each other, so checking the one at 
+              // our head (or the last one) checks them all.
+              if( head != INVALID_BLOCK_NUM && first.block_num <= head )
+              {
+                 uint32_t check_num = std::min( last_num, head );
+                 FC_ASSERT( msg.headers[check_num - first.block_num].id() == _db->fetch_block( check_num ).id(), 
+                            "headers fork below our head block", ("block_num",check_num) );
+              }
+
+              // check the whole batch before storing any of it
+              std::vector<block_id_type> ids;
+              ids.reserve( msg.headers.size() );
+              for( auto itr = msg.headers.begin(); itr != msg.headers.end(); ++itr )
+              {
+                 if( prev )
+                 {
+                    FC_ASSERT( itr->block_num == prev->block_num + 1 );
+                    FC_ASSERT( itr->prev == prev->id() );
+                    FC_ASSERT( itr->get_difficulty() >= itr->get_required_difficulty( prev->next_difficulty, prev->avail_coindays ),
+                               "insufficient proof of work", ("block_num",itr->block_num) );
+                 }
+                 ids.push_back( itr->id() );
+                 FC_ASSERT( _sync.invalid.count( ids.back() ) == 0, "headers contain an invalid block", ("block_num",itr->block_num) );
+                 prev = *itr;
+              }
+
+              // skip the headers we already have, both chains link back to the same block so 
+              // once one header differs from our header chain the rest of the batch does too
+              size_t fork = (head == INVALID_BLOCK_NUM || first.block_num > head) ? 0 : head - first.block_num + 1;
+              for( ; fork < msg.headers.size(); ++fork )
+              {
+                 auto existing = _sync.headers.find( msg.headers[fork].block_num );
+                 if( existing == _sync.headers.end() || existing->second.second != ids[fork] ) 
+                 {
+                    break;
+                 }
+              }
+
+              if( fork < msg.headers.size() )
+              {
+                 uint32_t fork_num = msg.headers[fork].block_num;
+                 auto existing     = _sync.headers.lower_bound( fork_num );
+                 if( existing != _sync.headers.end() )
+                 {
+                    // a competing header chain, only switch to it if it carries more work than ours from 
+                    // the fork on.  A longer chain can be made of cheap headers and next_difficulty is set
+                    // by whoever mined the previous block, so compare the work the hashes actually prove.
+                    fc::uint128 our_work, their_work;
+                    for( auto itr = existing; itr != _sync.headers.end(); ++itr )
+                    {
+                       our_work += bts::difficulty( itr->second.second );
+                    }
+                    for( size_t i = fork; i < ids.size(); ++i )
+                    {
+                       their_work += bts::difficulty( ids[i] );
+                    }
+                    if( their_work <= our_work ) 
+                    {
+                       return;
+                    }
+                    wlog( "switching header chain at block ${n}", ("n",fork_num) );
+                    _sync.headers.erase( existing, _sync.headers.end() );
+                    _sync.buffered.erase( _sync.buffered.lower_bound( fork_num ), _sync.buffered.end() );
+                    _sync.in_flight.erase( _sync.in_flight.lower_bound( fork_num ), _sync.in_flight.end() );
+                 }
+                 for( size_t i = fork; i < ids.size(); ++i )
+                 {
+                    _sync.headers[msg.headers[i].block_num] = std::make_pair( msg.headers[i], ids[i] );
+                 }
+              }
+              if( cdat.best_header_num == INVALID_BLOCK_NUM || last_num > cdat.best_header_num )
+              {
+                 cdat.best_header_num = last_num;
+              }
+
+              if( msg.headers.size() == BLOCK_INV_QUERY_LIMIT )
+              {
+                 request_headers( c ); // there are more
+              }
+              mark_assume_valid_headers();
+              schedule_sync_downloads();
+          } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) }
+
+          /**
+           *  Once the header chain links our head block to the assume valid checkpoint the
+           *  blocks in between are known ancestors of the checkpoint, let the db skip their 
+           *  signature checks.  Blocks that merely have a lower height are fully validated.
+           */
+          void mark_assume_valid_headers()
+          {
+              uint32_t checkpoint = _db->get_assume_valid_block_num();
+              uint32_t head       = _db->head_block_num();
+              if( checkpoint == INVALID_BLOCK_NUM || (head != INVALID_BLOCK_NUM && head >= checkpoint) ) 
+              {
+                 return;
+              }
+              auto checkpoint_itr = _sync.headers.find( checkpoint );
+              if( checkpoint_itr == _sync.headers.end() || checkpoint_itr->second.second != _db->get_assume_valid_block_id() )
+              {
+                 return;
+              }
+              if( _assume_valid_marked == checkpoint_itr->second.second )
+              {
+                 return; // the ids are proven ancestors whichever header chain we follow later
+              }
+
+              std::vector<block_id_type> ids;
+              block_id_type prev_id = head == INVALID_BLOCK_NUM ? block_id_type() : _db->head_block_id();
+              for( uint32_t num = head + 1; num <= checkpoint; ++num ) // INVALID_BLOCK_NUM + 1 == 0
+              {
+                 auto itr = _sync.headers.find( num );
+                 if( itr == _sync.headers.end() || itr->second.first.prev != prev_id ) 
+                 {
+                    return;
+                 }
+                 ids.push_back( itr->second.second );
+                 prev_id = itr->second.second;
+              }
+              _db->mark_assume_valid( ids );
+              _assume_valid_marked = checkpoint_itr->second.second;
+          }
+
+          /**
+           *  @return the connection with the fewest outstanding requests that has a header
+           *          for block_num, ignoring exclude.
+           */
+          connection_ptr pick_sync_connection( uint32_t block_num, const connection_ptr& exclude = connection_ptr() )
+          {
+              connection_ptr best;
+              size_t         best_load = BLOCKCHAIN_SYNC_MAX_REQUESTS_PER_PEER;
+              auto cons = _peers->get_connections( _chan_id );
+              for( auto itr = cons.begin(); itr != cons.end(); ++itr )
+              {
+                 if( *itr == exclude ) continue;
+                 chan_data& cdat = get_channel_data( *itr );
+                 if( cdat.best_header_num == INVALID_BLOCK_NUM || cdat.best_header_num < block_num ) continue;
+                 if( cdat.pruned_through != INVALID_BLOCK_NUM && cdat.pruned_through >= block_num ) continue;
+                 if( cdat.requested_blocks.size() < best_load )
+                 {
+                    best      = *itr;
+                    best_load = cdat.requested_blocks.size();
+                 }
+              }
+              return best;
+          }
+
+          /**
+           *  Requests block_num from the least loaded connection other than exclude.
+           *  @return false if no connection is available
+           */
+          bool request_sync_block( uint32_t block_num, const connection_ptr& exclude = connection_ptr() )
+          {
+              auto header_itr = _sync.headers.find( block_num );
+              if( header_itr == _sync.headers.end() ) return false;
+
+              auto con = pick_sync_connection( block_num, exclude );
+              if( !con && exclude ) 
+              {
+                 con = pick_sync_connection( block_num ); // better than nothing
+              }
+              if( !con ) return false;
+
+              const block_id_type& block_id = header_itr->second.second;
+              get_channel_data( con ).requested_blocks.insert( block_id );
+
+              sync_request& req = _sync.in_flight[block_num];
+              req.con       = con;
+              req.block_id  = block_id;
+              req.requested = fc::time_point::now();
+              _sync_timeouts.notify_at( req.requested + fc::seconds( BLOCKCHAIN_SYNC_TIMEOUT_SEC ) );
+              con->send( network::message( get_trx_block_message( block_id ), _chan_id ) );
+              return true;
+          }
+
+          /**
+           *  Fills the download window past our head block with requests.
+           */
+          void schedule_sync_downloads()
+          {
+              uint32_t next = _db->head_block_num() + 1; // INVALID_BLOCK_NUM + 1 == 0
+              // blocks may also arrive through compact relay, forget anything we no longer need
+              _sync.headers.erase( _sync.headers.begin(), _sync.headers.lower_bound( next ) );
+              _sync.buffered.erase( _sync.buffered.begin(), _sync.buffered.lower_bound( next ) );
+              _sync.in_flight.erase( _sync.in_flight.begin(), _sync.in_flight.lower_bound( next ) );
+
+              for( uint32_t num = next; num < next + BLOCKCHAIN_SYNC_WINDOW; ++num )
+              {
+                 if( _sync.headers.find( num ) == _sync.headers.end() ) break;
+                 if( _sync.buffered.count( num ) || _sync.in_flight.count( num ) ) continue;
+                 if( !request_sync_block( num ) ) break;
+              }
+          }
+
+          void handle_sync_block( const connection_ptr& c, trx_block blk )
+          { try {
+              auto block_id = blk.id();
+              auto header_itr = _sync.headers.find( blk.block_num );
+              FC_ASSERT( header_itr != _sync.headers.end() && header_itr->second.second == block_id, 
+                         "block does not match the header chain", ("block_num",blk.block_num) );
+
+              auto req_itr = _sync.in_flight.find( blk.block_num );
+              if( req_itr != _sync.in_flight.end() && req_itr->second.block_id == block_id )
+              {
+                 _sync.in_flight.erase( req_itr );
+              }
+              _sync.buffered[blk.block_num] = std::move( blk );
+
+              push_sync_blocks();
+              schedule_sync_downloads();
+          } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+          /**
+           *  Pushes buffered blocks onto the chain in order.
+           */
+          void push_sync_blocks()
+          {
+              for( auto itr = _sync.buffered.find( _db->head_block_num() + 1 ); 
+                   itr != _sync.buffered.end() && itr->first == _db->head_block_num() + 1;
+                   itr = _sync.buffered.find( _db->head_block_num() + 1 ) )
+              {
+                 trx_block blk = std::move( itr->second );
+                 _sync.buffered.erase( itr );
+                 try {
+                    _db->push_block( blk );
+                 } 
+                 catch ( const fc::exception& e )
+                 {
+                    // the header chain led us to an invalid block, start over from our head
+                    wlog( "unable to push synced block ${n}\n${e}", ("n",blk.block_num)("e",e.to_detail_string()) );
+                    _sync.invalid.insert( blk.id() );
+                    _sync.clear();
+                    auto cons = _peers->get_connections( _chan_id );
+                    for( auto con = cons.begin(); con != cons.end(); ++con )
+                    {
+                       request_headers( *con );
+                    }
+                    return;
+                 }
+                 _sync.headers.erase( blk.block_num );
+                 for( auto trx = blk.trxs.begin(); trx != blk.trxs.end(); ++trx )
+                 {
+                    _pending_trx.erase( trx->id() );
+                 }
+                 if( _del ) _del->handle_trx_block( blk );
+              }
+          }
+
+          /**
+           *  Re-requests blocks that have not arrived within BLOCKCHAIN_SYNC_TIMEOUT_SEC 
+           *  from another connection.  Scheduled by request_sync_block() for the time 
+           *  each request expires.
+           */
+          void expire_sync_requests()
+          {
+             auto deadline = fc::time_point::now() - fc::seconds( BLOCKCHAIN_SYNC_TIMEOUT_SEC );
+             std::vector<std::pair<uint32_t,connection_ptr> > expired;
+             for( auto itr = _sync.in_flight.begin(); itr != _sync.in_flight.end(); ++itr )
+             {
+                if( itr->second.requested <= deadline )
+                {
+                   expired.push_back( std::make_pair( itr->first, itr->second.con ) );
+                }
+                else
+                {
+                   _sync_timeouts.notify_at( itr->second.requested + fc::seconds( BLOCKCHAIN_SYNC_TIMEOUT_SEC ) );
+                }
+             }
+             for( auto itr = expired.begin(); itr != expired.end(); ++itr )
+             {
+                wlog( "block ${n} timed out, requesting it from another connection", ("n",itr->first) );
+                get_channel_data( itr->second ).requested_blocks.erase( _sync.in_flight[itr->first].block_id );
+                _sync.in_flight.erase( itr->first );
+                request_sync_block( itr->first, itr->second );
+             }
+             schedule_sync_downloads();
+          }
      };
 
   } // namespace detail 
@@ -354,17 +972,34 @@ namespace bts { namespace blockchain {
      my->_db      = db;
      my->_del     = d;
 
-     my->_peers->subscribe_to_channel( my->_chan_id, my );
+     // blocks and transaction batches dominate the bandwidth used during sync
+     my->_peers->subscribe_to_channel( my->_chan_id, my, network::zlib_compression );
+
+     // the scheduler is owned by the impl, a shared_ptr to it would form a cycle
+     auto self = my.get();
+     my->_sync_timeouts.start( [self](){ self->expire_sync_requests(); } );
   }
 
   channel::~channel()
   {
+     try {
+        my->_sync_timeouts.stop();
+     } 
+     catch ( ... ) 
+     {
+        wlog( "unexpected exception ${e}", ("e", fc::except_str()));
+     }
   }
   
   network::channel_id channel::get_id()const
   {
     return my->_chan_id;
   }
+
+  void channel::set_genesis_block_id( const block_id_type& id )
+  {
+     my->_genesis_id = id;
+  }
       
   /**
    *  All transactions that are known but that have not been included in 
@@ -387,6 +1022,7 @@ namespace bts { namespace blockchain {
         */
   void channel::broadcast( const trx_block& b )
   {
+     my->on_block_pushed( b );
   }
         
 
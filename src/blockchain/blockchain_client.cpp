@@ -1,6 +1,7 @@
 #include <bts/blockchain/blockchain_client.hpp>
 #include <bts/blockchain/blockchain_channel.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/config.hpp>
 
 #include <fc/reflect/variant.hpp>
 
@@ -32,6 +33,13 @@ namespace bts { namespace blockchain {
   void blockchain_client::configure( const config& aconfig )
   {
      my->_config = aconfig;
+     my->_chain_db->enable_address_index( my->_config.address_index );
+     my->_chain_db->set_prune_depth( my->_config.prune ? BLOCKCHAIN_DEFAULT_PRUNE_DEPTH : 0 );
+     my->_chain_db->set_evaluation_threads( my->_config.evaluation_threads );
+     if( my->_config.assume_valid_num )
+     {
+        my->_chain_db->set_assume_valid( *my->_config.assume_valid_num, my->_config.assume_valid_id );
+     }
      my->_chain_db->open( my->_config.data_dir / fc::variant(my->_config.chan_num).as_string() / "chaindb", true );
      
      // TODO: init chain with gensis block if necessary
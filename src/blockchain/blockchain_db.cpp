@@ -3,6 +3,7 @@
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/blockchain/blockchain_market_db.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/bloom_filter.hpp>
 #include <leveldb/db.h>
 #include <bts/db/level_pod_map.hpp>
 #include <bts/db/level_map.hpp>
@@ -14,12 +15,17 @@
 #include <fc/filesystem.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/json.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <algorithm>
+#include <future>
+#include <list>
 #include <sstream>
+#include <unordered_map>
 
 namespace fc {
   template<> struct get_typename<std::vector<uint160>>    { static const char* name()  { return "std::vector<uint160>";  } };
+  template<> struct get_typename<std::vector<bts::blockchain::trx_num>>    { static const char* name()  { return "std::vector<trx_num>";  } };
 } // namespace fc
 
 using namespace fc;
@@ -41,11 +47,150 @@ namespace bts { namespace blockchain {
     namespace detail  
     { 
       
+      /** blocks with fewer trxs than this are not worth evaluating in parallel */
+      const uint32_t min_parallel_trx_count = 16;
+
+      /** the known id filters are sized for at least this many ids and twice the ids in the db */
+      const uint64_t min_known_filter_items = 64*1024;
+      const double   known_filter_false_positive_rate = 0.001;
+
+      typedef std::shared_ptr<const std::vector<char> > packed_block_ptr;
+
+      /**
+       *  A size bounded LRU of packed trx_blocks and full_blocks so that the burst of
+       *  requests for a newly pushed block can be answered without touching the database
+       *  or serializing the block again.
+       */
+      class block_cache
+      {
+         public:
+            block_cache( uint64_t max_bytes = BLOCKCHAIN_BLOCK_CACHE_SIZE )
+            :_max_bytes(max_bytes),_bytes(0){}
+
+            packed_block_ptr get_trx_block( const block_id_type& id )
+            {
+               auto itr = _entries.find( id );
+               if( itr == _entries.end() ) return packed_block_ptr();
+               touch( itr->second );
+               return itr->second.trx_blk;
+            }
+
+            packed_block_ptr get_full_block( const block_id_type& id )
+            {
+               auto itr = _entries.find( id );
+               if( itr == _entries.end() ) return packed_block_ptr();
+               touch( itr->second );
+               return itr->second.full_blk;
+            }
+
+            fc::optional<block_id_type> get_id( uint32_t block_num )const
+            {
+               auto itr = _ids_by_num.find( block_num );
+               if( itr == _ids_by_num.end() ) return fc::optional<block_id_type>();
+               return itr->second;
+            }
+
+            void store_trx_block( const block_id_type& id, uint32_t block_num, const packed_block_ptr& packed )
+            {
+               entry& e = get_entry( id, block_num );
+               if( e.trx_blk ) _bytes -= e.trx_blk->size();
+               e.trx_blk = packed;
+               _bytes += packed->size();
+               evict();
+            }
+
+            void store_full_block( const block_id_type& id, uint32_t block_num, const packed_block_ptr& packed )
+            {
+               entry& e = get_entry( id, block_num );
+               if( e.full_blk ) _bytes -= e.full_blk->size();
+               e.full_blk = packed;
+               _bytes += packed->size();
+               evict();
+            }
+
+         private:
+            struct entry
+            {
+               uint32_t                             block_num;
+               packed_block_ptr                     trx_blk;
+               packed_block_ptr                     full_blk;
+               std::list<block_id_type>::iterator   lru_pos;
+            };
+
+            entry& get_entry( const block_id_type& id, uint32_t block_num )
+            {
+               auto itr = _entries.find( id );
+               if( itr != _entries.end() )
+               {
+                  touch( itr->second );
+                  return itr->second;
+               }
+               entry& e    = _entries[id];
+               e.block_num = block_num;
+               e.lru_pos   = _lru.insert( _lru.end(), id );
+               _ids_by_num[block_num] = id;
+               return e;
+            }
+
+            void touch( entry& e )
+            {
+               _lru.splice( _lru.end(), _lru, e.lru_pos );
+            }
+
+            /** drops the least recently used blocks, but always keeps the newest one */
+            void evict()
+            {
+               while( _bytes > _max_bytes && _lru.size() > 1 )
+               {
+                  auto itr = _entries.find( _lru.front() );
+                  if( itr->second.trx_blk )  _bytes -= itr->second.trx_blk->size();
+                  if( itr->second.full_blk ) _bytes -= itr->second.full_blk->size();
+
+                  auto num_itr = _ids_by_num.find( itr->second.block_num );
+                  if( num_itr != _ids_by_num.end() && num_itr->second == itr->first )
+                  {
+                     _ids_by_num.erase( num_itr );
+                  }
+                  _entries.erase( itr );
+                  _lru.pop_front();
+               }
+            }
+
+            uint64_t                                       _max_bytes;
+            uint64_t                                       _bytes;
+            std::list<block_id_type>                       _lru; // least recently used first
+            std::unordered_map<block_id_type,entry>        _entries;
+            std::unordered_map<uint32_t,block_id_type>     _ids_by_num;
+      };
+
+      /** an evaluate_signed_transaction() call made on behalf of evaluate_signed_transactions() */
+      struct eval_task
+      {
+         eval_task( uint32_t i, bool ignore, bool market )
+         :trx_idx(i),ignore_fees(ignore),is_market(market){}
+
+         uint32_t trx_idx;
+         bool     ignore_fees;
+         bool     is_market;
+      };
+      
       // TODO: .01 BTC update private members to use _member naming convention
       class blockchain_db_impl
       {
          public:
-            blockchain_db_impl(){}
+            blockchain_db_impl()
+            :_address_index_enabled(false),
+             _prune_depth(0),
+             _pruned_through(INVALID_BLOCK_NUM),
+             _assume_valid_num(INVALID_BLOCK_NUM){}
+
+            ~blockchain_db_impl()
+            {
+               if( _compaction_complete.valid() ) 
+               {
+                  _compaction_complete.wait();
+               }
+            }
 
             //std::unique_ptr<ldb::DB> blk_id2num;  // maps blocks to unique IDs
             bts::db::level_map<block_id_type,uint32_t>          blk_id2num;
@@ -54,6 +199,75 @@ namespace bts { namespace blockchain {
             bts::db::level_map<uint32_t,block_header>           blocks;
             bts::db::level_map<uint32_t,std::vector<uint160> >  block_trxs; 
 
+            /** optional indexes of outputs by owner, see blockchain_db::enable_address_index */
+            bool                                                          _address_index_enabled;
+            bts::db::level_map<address_output_key,address_output>         _address_index;
+            bts::db::level_map<pts_address_output_key,address_output>     _pts_address_index;
+            /** the last block added to the address index */
+            bts::db::level_map<std::string,uint32_t>                      _address_index_state;
+
+            /** see blockchain_db::set_prune_depth, 0 keeps the full history */
+            uint32_t                                                      _prune_depth;
+            /** fully spent trxs indexed by the block that spent their last output */
+            bts::db::level_map<uint32_t,std::vector<trx_num> >            _prune_queue;
+            /** the last block whose history has been pruned */
+            bts::db::level_map<std::string,uint32_t>                      _prune_state;
+            uint32_t                                                      _pruned_through;
+            std::unique_ptr<fc::thread>                                   _compaction_thread;
+            fc::future<void>                                              _compaction_complete;
+
+            /** see blockchain_db::set_assume_valid */
+            uint32_t                                                      _assume_valid_num;
+            block_id_type                                                 _assume_valid_id;
+            /** blocks proven to be ancestors of _assume_valid_id, see blockchain_db::mark_assume_valid */
+            std::unordered_set<block_id_type>                             _assume_valid_ancestors;
+
+            /** see blockchain_db::set_evaluation_threads, empty to evaluate serially */
+            std::vector<std::unique_ptr<fc::thread>>                      _eval_threads;
+
+            /** 
+             *  In memory filters of every id in trx_id2num and blk_id2num so that lookups of 
+             *  unknown ids, the common case for inventory, never hit the disk.
+             */
+            bts::bloom_filter                                             _known_trx_filter;
+            bts::bloom_filter                                             _known_block_filter;
+
+            block_cache                                                   _block_cache;
+
+            template<typename Value>
+            static void rebuild_known_filter( bts::db::level_map<uint160,Value>& ids, bts::bloom_filter& filter )
+            {
+               std::vector<uint160> known;
+               for( auto itr = ids.begin(); itr.valid(); ++itr )
+               {
+                  known.push_back( itr.key() );
+               }
+               filter = bts::bloom_filter( std::max<uint64_t>( 2*known.size(), min_known_filter_items ),
+                                           known_filter_false_positive_rate );
+               for( auto itr = known.begin(); itr != known.end(); ++itr )
+               {
+                  filter.insert( (const char*)&*itr, sizeof(*itr) );
+               }
+            }
+
+            void add_known_trx( const uint160& trx_id )
+            {
+               _known_trx_filter.insert( (const char*)&trx_id, sizeof(trx_id) );
+               if( _known_trx_filter.is_saturated() )
+               {
+                  rebuild_known_filter( trx_id2num, _known_trx_filter );
+               }
+            }
+
+            void add_known_block( const block_id_type& block_id )
+            {
+               _known_block_filter.insert( (const char*)&block_id, sizeof(block_id) );
+               if( _known_block_filter.is_saturated() )
+               {
+                  rebuild_known_filter( blk_id2num, _known_block_filter );
+               }
+            }
+
             market_db                                           _market_db;
 
             /** cache this information because it is required in many calculations  */
@@ -71,6 +285,116 @@ namespace bts { namespace blockchain {
 
                meta_trxs.store( tid, mtrx );
                remove_market_orders( o );
+
+               if( _prune_depth && is_fully_spent( mtrx ) )
+               {
+                  queue_prune( intrx.block_num, tid );
+               }
+            }
+
+            static bool is_fully_spent( const meta_trx& mtrx )
+            {
+               for( auto itr = mtrx.meta_outputs.begin(); itr != mtrx.meta_outputs.end(); ++itr )
+               {
+                  if( !itr->is_spent() ) return false;
+               }
+               return true;
+            }
+
+            /**
+             *  Schedules tn to be pruned once spent_block_num falls behind the prune horizon 
+             */
+            void queue_prune( uint32_t spent_block_num, const trx_num& tn )
+            {
+               std::vector<trx_num> queued;
+               auto itr = _prune_queue.find( spent_block_num );
+               if( itr.valid() ) 
+               {
+                  queued = itr.value();
+               }
+               queued.push_back( tn );
+               _prune_queue.store( spent_block_num, queued );
+            }
+
+            /**
+             *  Queues every fully spent trx, used when pruning is enabled on a database that 
+             *  was built without it.
+             */
+            void build_prune_queue()
+            {
+               ilog( "building prune queue" );
+               for( auto itr = meta_trxs.begin(); itr.valid(); ++itr )
+               {
+                  meta_trx mtrx = itr.value();
+                  if( !is_fully_spent( mtrx ) ) continue;
+
+                  uint32_t spent_block_num = itr.key().block_num;
+                  for( auto out = mtrx.meta_outputs.begin(); out != mtrx.meta_outputs.end(); ++out )
+                  {
+                     spent_block_num = std::max( spent_block_num, out->trx_id.block_num );
+                  }
+                  queue_prune( spent_block_num, itr.key() );
+               }
+            }
+
+            /**
+             *  Removes the bodies and ids of all trxs whose last output was spent at or 
+             *  before horizon.  Block headers and block_trxs are kept.
+             */
+            void prune_history( uint32_t horizon )
+            {
+               for( auto itr = _prune_queue.begin(); itr.valid() && itr.key() <= horizon; ++itr )
+               {
+                  auto queued = itr.value();
+                  for( auto tn = queued.begin(); tn != queued.end(); ++tn )
+                  {
+                     auto mtrx_itr = meta_trxs.find( *tn );
+                     if( !mtrx_itr.valid() ) continue;
+
+                     // a queued trx may have become unspent again if the block that spent it
+                     // was replaced, it is queued again once it is fully spent
+                     meta_trx mtrx = mtrx_itr.value();
+                     if( !is_fully_spent( mtrx ) ) continue;
+
+                     auto trx_id  = mtrx.id();
+                     auto num_itr = trx_id2num.find( trx_id );
+                     if( num_itr.valid() && num_itr.value() == *tn )
+                     {
+                        trx_id2num.remove( trx_id );
+                     }
+                     meta_trxs.remove( *tn );
+                  }
+                  _prune_queue.remove( itr.key() );
+               }
+               _pruned_through = horizon;
+               _prune_state.store( "pruned_through", horizon );
+
+               if( horizon % BLOCKCHAIN_PRUNE_COMPACTION_INTERVAL == 0 )
+               {
+                  compact_in_background();
+               }
+            }
+
+            /**
+             *  LevelDB only reclaims the space of removed items as it compacts, so force
+             *  a compaction of the pruned maps without blocking block processing.
+             */
+            void compact_in_background()
+            {
+               if( _compaction_complete.valid() && !_compaction_complete.ready() )
+               {
+                  return; // still working on the last one
+               }
+               if( !_compaction_thread )
+               {
+                  _compaction_thread.reset( new fc::thread( "compaction" ) );
+               }
+               _compaction_complete = _compaction_thread->async( [this]() 
+               {
+                  meta_trxs.compact();
+                  trx_id2num.compact();
+                  _prune_queue.compact();
+               } );
             }
 
 
@@ -119,7 +443,9 @@ namespace bts { namespace blockchain {
             {
                ilog( "trxid: ${id}   ${tn}\n\n  ${trx}\n\n", ("id",t.id())("tn",tn)("trx",t) );
 
-               trx_id2num.store( t.id(), tn ); 
+               auto trx_id = t.id();
+               trx_id2num.store( trx_id, tn ); 
+               add_known_trx( trx_id );
                meta_trxs.store( tn, meta_trx(t) );
 
                for( uint16_t i = 0; i < t.inputs.size(); ++i )
@@ -163,19 +489,137 @@ namespace bts { namespace blockchain {
                }
             }
 
+            /**
+             *  Adds every owned output of t to the address index
+             */
+            void index_addresses( const signed_transaction& t, const trx_num& tn )
+            {
+               auto trx_id = t.id();
+               for( uint8_t i = 0; i < t.outputs.size(); ++i )
+               {
+                  const trx_output& out = t.outputs[i];
+                  fc::optional<address> owner;
+                  switch( out.claim_func )
+                  {
+                     case claim_by_signature:
+                        owner = out.as<claim_by_signature_output>().owner;
+                        break;
+                     case claim_by_bid:
+                        owner = out.as<claim_by_bid_output>().pay_address;
+                        break;
+                     case claim_by_long:
+                        owner = out.as<claim_by_long_output>().pay_address;
+                        break;
+                     case claim_by_cover:
+                        owner = out.as<claim_by_cover_output>().owner;
+                        break;
+                     case claim_by_pts:
+                     {
+                        pts_address_output_key key( out.as<claim_by_pts_output>().owner, tn, i );
+                        _pts_address_index.store( key, address_output( tn, trx_id, i, out ) );
+                        break;
+                     }
+                     default:
+                        break;
+                  }
+                  if( owner )
+                  {
+                     address_output_key key( *owner, tn, i );
+                     _address_index.store( key, address_output( tn, trx_id, i, out ) );
+                  }
+               }
+            }
+
+            void index_addresses( uint32_t block_num )
+            {
+               auto trx_ids = block_trxs.fetch( block_num );
+               for( uint16_t t = 0; t < trx_ids.size(); ++t )
+               {
+                  trx_num tn( block_num, t );
+                  auto mtrx_itr = meta_trxs.find( tn );
+                  if( mtrx_itr.valid() ) // pruned trxs have no unspent outputs
+                  {
+                     index_addresses( mtrx_itr.value(), tn );
+                  }
+               }
+               _address_index_state.store( "head", block_num );
+            }
+
+            template<typename KeyType, typename AddressType>
+            std::vector<address_output> fetch_address_outputs( bts::db::level_map<KeyType,address_output>& index, 
+                                                               const AddressType& owner, 
+                                                               const trx_num& start, uint32_t limit )
+            {
+               std::vector<address_output> outputs;
+               std::vector<KeyType>        stale;
+               uint32_t                    ids_block_num = INVALID_BLOCK_NUM;
+               std::vector<uint160>        ids;
+               auto itr = index.lower_bound( KeyType( owner, start, 0 ) );
+               while( itr.valid() && outputs.size() < limit )
+               {
+                  auto key = itr.key();
+                  if( key.owner != owner ) 
+                  {
+                     break;
+                  }
+                  if( key.trx.block_num > head_block.block_num || head_block.block_num == INVALID_BLOCK_NUM ) 
+                  {
+                     break;
+                  }
+                  // a block at this height may have replaced the one that was indexed
+                  if( key.trx.block_num != ids_block_num )
+                  {
+                     ids_block_num = key.trx.block_num;
+                     ids           = block_trxs.fetch( ids_block_num );
+                  }
+                  auto out = itr.value();
+                  if( key.trx.trx_idx < ids.size() && ids[key.trx.trx_idx] == out.trx_id )
+                  {
+                     outputs.push_back( out );
+                  }
+                  else
+                  {
+                     stale.push_back( key );
+                  }
+                  ++itr;
+               }
+               for( auto key = stale.begin(); key != stale.end(); ++key )
+               {
+                  index.remove( *key );
+               }
+               return outputs;
+            }
+
             void store( const trx_block& b )
             {
                 std::vector<uint160> trxs_ids;
                 for( uint16_t t = 0; t < b.trxs.size(); ++t )
                 {
                    store( b.trxs[t], trx_num( b.block_num, t) );
+                   if( _prune_depth && b.trxs[t].outputs.size() == 0 )
+                   {
+                      queue_prune( b.block_num, trx_num( b.block_num, t ) );
+                   }
+                   if( _address_index_enabled )
+                   {
+                      index_addresses( b.trxs[t], trx_num( b.block_num, t ) );
+                   }
                    trxs_ids.push_back( b.trxs[t].id() );
                 }
+                if( _address_index_enabled )
+                {
+                   _address_index_state.store( "head", b.block_num );
+                }
                 head_block    = b;
                 head_block_id = b.id();
 
                 blocks.store( b.block_num, b );
                 block_trxs.store( b.block_num, trxs_ids );
+
+                if( _prune_depth && b.block_num > _prune_depth )
+                {
+                   prune_history( b.block_num - _prune_depth );
+                }
             }
 
             /**
@@ -796,18 +1240,139 @@ namespace bts { namespace blockchain {
             my->head_block_id = my->head_block.id();
          }
 
+         my->rebuild_known_filter( my->trx_id2num, my->_known_trx_filter );
+         my->rebuild_known_filter( my->blk_id2num, my->_known_block_filter );
+
+         my->_prune_state.open( dir / "prune_state", true );
+         auto pruned_itr = my->_prune_state.find( "pruned_through" );
+         my->_pruned_through = pruned_itr.valid() ? pruned_itr.value() : INVALID_BLOCK_NUM;
+         if( my->_prune_depth )
+         {
+            bool new_queue = !fc::exists( dir / "prune_queue" );
+            my->_prune_queue.open( dir / "prune_queue", true );
+            if( new_queue && my->head_block.block_num != INVALID_BLOCK_NUM )
+            {
+               my->build_prune_queue();
+            }
+         }
+
+         if( my->_address_index_enabled )
+         {
+            my->_address_index.open( dir / "address_index", true );
+            my->_pts_address_index.open( dir / "pts_address_index", true );
+            my->_address_index_state.open( dir / "address_index_state", true );
+
+            // catch up with any blocks pushed while the index was disabled
+            auto state_itr = my->_address_index_state.find( "head" );
+            uint32_t index_head = state_itr.valid() ? state_itr.value() : INVALID_BLOCK_NUM;
+            if( my->head_block.block_num != INVALID_BLOCK_NUM )
+            {
+               uint32_t first = index_head == INVALID_BLOCK_NUM ? 0 : index_head + 1;
+               if( index_head == INVALID_BLOCK_NUM || index_head < my->head_block.block_num )
+               {
+                  ilog( "building address index from block ${b}", ("b",first) );
+                  for( uint32_t block_num = first; block_num <= my->head_block.block_num; ++block_num )
+                  {
+                     my->index_addresses( block_num );
+                  }
+               }
+            }
+         }
+
        } FC_RETHROW_EXCEPTIONS( warn, "error loading blockchain database ${dir}", ("dir",dir)("create",create) );
      }
 
      void blockchain_db::close()
      {
+        if( my->_compaction_complete.valid() )
+        {
+           my->_compaction_complete.wait();
+        }
         my->blk_id2num.close();
         my->trx_id2num.close();
         my->blocks.close();
         my->block_trxs.close();
         my->meta_trxs.close();
+        if( my->_address_index_enabled )
+        {
+           my->_address_index.close();
+           my->_pts_address_index.close();
+           my->_address_index_state.close();
+        }
+        if( my->_prune_depth )
+        {
+           my->_prune_queue.close();
+        }
+        my->_prune_state.close();
+     }
+
+     void blockchain_db::enable_address_index( bool enable )
+     {
+        my->_address_index_enabled = enable;
+     }
+
+     bool blockchain_db::has_address_index()const
+     {
+        return my->_address_index_enabled;
+     }
+
+     void blockchain_db::set_prune_depth( uint32_t depth )
+     {
+        my->_prune_depth = depth;
+     }
+
+     uint32_t blockchain_db::get_prune_depth()const
+     {
+        return my->_prune_depth;
+     }
+
+     bool blockchain_db::is_block_pruned( uint32_t block_num )const
+     {
+        return my->_pruned_through != INVALID_BLOCK_NUM && block_num <= my->_pruned_through;
+     }
+
+     void blockchain_db::set_assume_valid( uint32_t block_num, const block_id_type& id )
+     {
+        my->_assume_valid_num = block_num;
+        my->_assume_valid_id  = id;
+     }
+
+     uint32_t blockchain_db::get_assume_valid_block_num()const
+     {
+        return my->_assume_valid_num;
+     }
+
+     block_id_type blockchain_db::get_assume_valid_block_id()const
+     {
+        return my->_assume_valid_id;
+     }
+
+     void blockchain_db::mark_assume_valid( const std::vector<block_id_type>& ids )
+     {
+        my->_assume_valid_ancestors.insert( ids.begin(), ids.end() );
+     }
+
+     void blockchain_db::set_evaluation_threads( uint32_t num_threads )
+     {
+        my->_eval_threads.clear();
+        for( uint32_t i = 0; i < num_threads; ++i )
+        {
+           my->_eval_threads.emplace_back( new fc::thread( "evaluate" ) );
+        }
      }
 
+     std::vector<address_output> blockchain_db::fetch_address_outputs( const address& owner, const trx_num& start, uint32_t limit )
+     { try {
+        FC_ASSERT( has_address_index() );
+        return my->fetch_address_outputs( my->_address_index, owner, start, limit );
+     } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner)("start",start)("limit",limit) ) }
+
+     std::vector<address_output> blockchain_db::fetch_address_outputs( const pts_address& owner, const trx_num& start, uint32_t limit )
+     { try {
+        FC_ASSERT( has_address_index() );
+        return my->fetch_address_outputs( my->_pts_address_index, owner, start, limit );
+     } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner)("start",start)("limit",limit) ) }
+
     uint32_t blockchain_db::head_block_num()const
     {
        return my->head_block.block_num;
@@ -850,6 +1415,29 @@ namespace bts { namespace blockchain {
        return my->meta_trxs.fetch( trx_id );
     } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
 
+    bool        blockchain_db::has_trx( const trx_num& t )
+    { try {
+       return my->meta_trxs.find( t ).valid();
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_num ${t}", ("t",t) ) }
+
+    bool blockchain_db::is_known_trx( const transaction_id_type& trx_id )
+    { try {
+       if( !my->_known_trx_filter.contains( (const char*)&trx_id, sizeof(trx_id) ) )
+       {
+          return false;
+       }
+       return my->trx_id2num.find( trx_id ).valid(); // possible false positive
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
+    bool blockchain_db::is_known_block( const block_id_type& block_id )
+    { try {
+       if( !my->_known_block_filter.contains( (const char*)&block_id, sizeof(block_id) ) )
+       {
+          return false;
+       }
+       return my->blk_id2num.find( block_id ).valid(); // possible false positive
+    } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
+
     uint32_t    blockchain_db::fetch_block_num( const block_id_type& block_id )
     { try {
        return my->blk_id2num.fetch( block_id ); 
@@ -869,6 +1457,16 @@ namespace bts { namespace blockchain {
 
     trx_block  blockchain_db::fetch_trx_block( uint32_t block_num )
     { try {
+       FC_ASSERT( !is_block_pruned( block_num ), "block ${block} has been pruned", ("block",block_num) );
+       auto cached_id = my->_block_cache.get_id( block_num );
+       if( cached_id )
+       {
+          auto packed = my->_block_cache.get_trx_block( *cached_id );
+          if( packed )
+          {
+             return fc::raw::unpack<trx_block>( *packed );
+          }
+       }
        trx_block fb = my->blocks.fetch(block_num);
        auto trx_ids = my->block_trxs.fetch( block_num );
        for( uint32_t i = 0; i < trx_ids.size(); ++i )
@@ -881,6 +1479,30 @@ namespace bts { namespace blockchain {
        return fb;
     } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
 
+    std::shared_ptr<const std::vector<char> > blockchain_db::fetch_packed_full_block( const block_id_type& block_id )
+    { try {
+       auto packed = my->_block_cache.get_full_block( block_id );
+       if( !packed )
+       {
+          uint32_t block_num = fetch_block_num( block_id );
+          packed = std::make_shared<const std::vector<char> >( fc::raw::pack( fetch_full_block( block_num ) ) );
+          my->_block_cache.store_full_block( block_id, block_num, packed );
+       }
+       return packed;
+    } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
+
+    std::shared_ptr<const std::vector<char> > blockchain_db::fetch_packed_trx_block( const block_id_type& block_id )
+    { try {
+       auto packed = my->_block_cache.get_trx_block( block_id );
+       if( !packed )
+       {
+          uint32_t block_num = fetch_block_num( block_id );
+          packed = std::make_shared<const std::vector<char> >( fc::raw::pack( fetch_trx_block( block_num ) ) );
+          my->_block_cache.store_trx_block( block_id, block_num, packed );
+       }
+       return packed;
+    } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
+
     signed_transaction blockchain_db::fetch_transaction( const transaction_id_type& id )
     { try {
           auto trx_num = fetch_trx_num(id);
@@ -897,13 +1519,20 @@ namespace bts { namespace blockchain {
             head = head_block_num();
           }
 
-          std::vector<meta_trx_input> rtn;
-          rtn.reserve( inputs.size() );
+          std::vector<meta_trx_input> rtn( inputs.size() );
+
+          // inputs spending several outputs of the same trx are usually adjacent, only 
+          // unpack the source trx once for them and move the outputs out of it on last use
+          trx_num  tn;
+          meta_trx trx;
           for( uint32_t i = 0; i < inputs.size(); ++i )
           {
             try {
-             trx_num tn   = fetch_trx_num( inputs[i].output_ref.trx_hash );
-             meta_trx trx = fetch_trx( tn );
+             if( i == 0 || inputs[i].output_ref.trx_hash != inputs[i-1].output_ref.trx_hash )
+             {
+                tn  = fetch_trx_num( inputs[i].output_ref.trx_hash );
+                trx = fetch_trx( tn );
+             }
              
              if( inputs[i].output_ref.output_idx >= trx.meta_outputs.size() )
              {
@@ -916,12 +1545,15 @@ namespace bts { namespace blockchain {
                                     ("i",inputs[i])("o", trx) );
              }
 
-             meta_trx_input metin;
+             bool reused = i + 1 < inputs.size() && 
+                           inputs[i+1].output_ref.trx_hash == inputs[i].output_ref.trx_hash;
+
+             meta_trx_input& metin = rtn[i];
              metin.source       = tn;
              metin.output_num   = inputs[i].output_ref.output_idx;
-             metin.output       = trx.outputs[metin.output_num];
+             if( reused ) metin.output = trx.outputs[metin.output_num];
+             else         metin.output = std::move( trx.outputs[metin.output_num] );
              metin.meta_output  = trx.meta_outputs[metin.output_num];
-             rtn.push_back( metin );
 
             } FC_RETHROW_EXCEPTIONS( warn, "error fetching input [${i}] ${in}", ("i",i)("in", inputs[i]) );
           }
@@ -940,7 +1572,8 @@ namespace bts { namespace blockchain {
      *
      *  @throw exception if trx can not be applied to the current chain state.
      */
-    trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees, bool is_market  )       
+    trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees, bool is_market, 
+                                                         bool skip_signatures )       
     {
        try {
            FC_ASSERT( trx.inputs.size() || trx.outputs.size() );
@@ -957,6 +1590,7 @@ namespace bts { namespace blockchain {
 
            trx_validation_state vstate( trx, this ); 
            vstate.allow_short_long_matching = is_market;
+           vstate.skip_signatures = skip_signatures;
            vstate.prev_block_id1 = get_stake();
            vstate.prev_block_id2 = get_stake2();
            vstate.validate();
@@ -991,54 +1625,120 @@ namespace bts { namespace blockchain {
 
 
 
-    trx_eval blockchain_db::evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n_fees )
+    trx_eval blockchain_db::evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n_fees,
+                                                          bool skip_signatures )
     {
       try {
-        trx_eval total_eval;
+        // build the list of evaluations in block order, the mining reward pairing at the end
+        // of the block depends upon the fees of everything before it and is done afterward
+        std::vector<detail::eval_task> tasks;
+        tasks.reserve( trxs.size() + ignore_first_n_fees );
+        fc::optional<uint32_t> mining_trx; // index of the trx paired with the reward trx
         for( uint32_t i = 0; i < trxs.size(); ++i )
         {
             // ignore fees for the market trxs and for the mining transaction... assuming there is a mining trx??
             if( i < ignore_first_n_fees )
             {
-               total_eval += evaluate_signed_transaction( trxs[i], true, true );
+               tasks.push_back( detail::eval_task( i, true, true ) );
             }
-            bts::address mining_addr;
             if( i == trxs.size() - 1 ) // last trx..
             {
-               if( trxs.back().inputs.size() == 0 )
+               if( trxs.back().inputs.size() == 0 && trxs.size() > 1 &&
+                   trxs[i-1].outputs.size() == 1 && // mining trx can only have 1 output
+                   trxs[i-1].outputs[0].claim_func == claim_by_signature ) // mining trx must be claim by sig
                {
-                  if( trxs.size() > 1 ) 
-                  {
-                     if( trxs[i-1].outputs.size() == 1 ) // mining trx can only have 1 output
-                     {
-                        if( trxs[i-1].outputs[0].claim_func == claim_by_signature ) // mining trx must be claim by sig
-                        {
-                           mining_addr =  trxs[i-1].outputs[0].as<claim_by_signature_output>().owner;
-                           FC_ASSERT( trxs.back().outputs.size() == 1 ); // only allowed 1 output
-                           FC_ASSERT( trxs.back().outputs.back().as<claim_by_signature_output>().owner == mining_addr ); // must match
-
-                           auto prev_eval = evaluate_signed_transaction( trxs[i-1], true );
-
-                           auto rew = (total_eval.fees.get_rounded_amount() * prev_eval.coindays_destroyed )/
-                                                total_eval.coindays_destroyed;
-                           asset mining_reward(rew, asset::bts); 
-                           // calculate mining reward... 
-                           FC_ASSERT( trxs.back().outputs.back().amount == mining_reward );
-                        }
-                     }
-                  }
+                  mining_trx = i - 1;
                }
-               if( mining_addr == bts::address() ) // process like normal
+               else // process like normal
                {
-                  total_eval += evaluate_signed_transaction( trxs[i], false );
+                  tasks.push_back( detail::eval_task( i, false, false ) );
                }
             }
             else 
             {
-               total_eval += evaluate_signed_transaction( trxs[i], 
-                                    (i == trxs.size()-1) || (i < ignore_first_n_fees) );
+               tasks.push_back( detail::eval_task( i, (i == trxs.size()-1) || (i < ignore_first_n_fees), false ) );
             }
         }
+
+        trx_eval total_eval;
+        if( my->_eval_threads.size() == 0 || tasks.size() < detail::min_parallel_trx_count )
+        {
+           for( auto itr = tasks.begin(); itr != tasks.end(); ++itr )
+           {
+              total_eval += evaluate_signed_transaction( trxs[itr->trx_idx], itr->ignore_fees, itr->is_market, skip_signatures );
+           }
+        }
+        else
+        {
+           // validate_unique_inputs() has already proven that no two trxs spend the same output
+           // and evaluation only reads chain state, so each thread evaluates a contiguous slice.
+           // Slices stop at their first failure and are summed in order, so the reported failure
+           // is always the first one in the block.
+           //
+           // The join blocks this OS thread instead of yielding the fiber: a yield here would let 
+           // other tasks on the db thread run in the middle of push_block and the slices reference
+           // trxs and tasks, so this frame must not be canceled or unwound while they run.
+           uint32_t slice_size = (tasks.size() + my->_eval_threads.size() - 1) / my->_eval_threads.size();
+           uint32_t slice_count = (tasks.size() + slice_size - 1) / slice_size;
+           std::vector<std::promise<trx_eval>> slice_results( slice_count );
+           std::vector<std::future<trx_eval>>  slices;
+           slices.reserve( slice_count );
+           for( uint32_t s = 0; s < slice_count; ++s )
+           {
+              uint32_t start = s * slice_size;
+              uint32_t end   = std::min<uint32_t>( start + slice_size, tasks.size() );
+              std::promise<trx_eval>* result = &slice_results[s];
+              slices.push_back( result->get_future() );
+              my->_eval_threads[s]->async( [=,&trxs,&tasks]() {
+                 try {
+                    trx_eval slice_eval;
+                    for( uint32_t t = start; t < end; ++t )
+                    {
+                       try {
+                          slice_eval += evaluate_signed_transaction( trxs[tasks[t].trx_idx], tasks[t].ignore_fees, 
+                                                                     tasks[t].is_market, skip_signatures );
+                       } FC_RETHROW_EXCEPTIONS( warn, "error evaluating trx ${i}", ("i",tasks[t].trx_idx) )
+                    }
+                    result->set_value( slice_eval );
+                 }
+                 catch ( ... )
+                 {
+                    result->set_exception( std::current_exception() );
+                 }
+              } );
+           }
+           for( uint32_t i = 0; i < slices.size(); ++i )
+           {
+              try {
+                 total_eval += slices[i].get();
+              }
+              catch ( ... )
+              {
+                 // the slices reference trxs, tasks and slice_results, let the rest finish before unwinding
+                 for( uint32_t j = i + 1; j < slices.size(); ++j )
+                 {
+                    slices[j].wait();
+                 }
+                 throw;
+              }
+           }
+        }
+
+        if( mining_trx )
+        {
+           uint32_t i = trxs.size() - 1;
+           bts::address mining_addr =  trxs[*mining_trx].outputs[0].as<claim_by_signature_output>().owner;
+           FC_ASSERT( trxs.back().outputs.size() == 1 ); // only allowed 1 output
+           FC_ASSERT( trxs.back().outputs.back().as<claim_by_signature_output>().owner == mining_addr ); // must match
+
+           auto prev_eval = evaluate_signed_transaction( trxs[i-1], true, false, skip_signatures );
+
+           auto rew = (total_eval.fees.get_rounded_amount() * prev_eval.coindays_destroyed )/
+                                total_eval.coindays_destroyed;
+           asset mining_reward(rew, asset::bts); 
+           // calculate mining reward... 
+           FC_ASSERT( trxs.back().outputs.back().amount == mining_reward );
+        }
         ilog( "summary: ${totals}", ("totals",total_eval) );
         return total_eval;
       } FC_RETHROW_EXCEPTIONS( debug, "" );
@@ -1100,19 +1800,35 @@ namespace bts { namespace blockchain {
            FC_ASSERT( matched[i].id() == b.trxs[i].id(), "", ("i",i)("matched",matched) );
         }
 
+        // ancestors of the assume valid checkpoint only skip signature checks, 
+        // everything that affects balances is still evaluated
+        auto block_id = b.id();
+        bool assumed_valid = my->_assume_valid_ancestors.count( block_id ) != 0;
+        if( b.block_num == my->_assume_valid_num )
+        {
+           FC_ASSERT( block_id == my->_assume_valid_id, "block does not match the assume valid checkpoint", 
+                      ("checkpoint",my->_assume_valid_id)("block_num",b.block_num) );
+        }
+
         // evaluate all trx and sum the results
-        trx_eval total_eval = evaluate_signed_transactions( b.trxs, matched.size() );
+        trx_eval total_eval = evaluate_signed_transactions( b.trxs, matched.size(), assumed_valid );
         
         wlog( "total_fees: ${tf}", ("tf", total_eval.fees ) );
 
         my->store( b );
+        my->_assume_valid_ancestors.erase( block_id );
 
         for( auto pt : order_stats )
         {
            my->_market_db.push_price_point( pt );
         }
 
-        my->blk_id2num.store( b.id(), b.block_num );
+        my->blk_id2num.store( block_id, b.block_num );
+        my->add_known_block( block_id );
+
+        // every peer will be asking for this block shortly
+        my->_block_cache.store_trx_block( block_id, b.block_num, 
+                                          std::make_shared<const std::vector<char> >( fc::raw::pack( b ) ) );
         
       } FC_RETHROW_EXCEPTIONS( warn, "unable to push block", ("b", b) );
     }
@@ -1123,6 +1839,8 @@ namespace bts { namespace blockchain {
      */
     void blockchain_db::pop_block( full_block& b, std::vector<signed_transaction>& trxs )
     {
+       // TODO: when implemented, pruning never touches the last prune depth blocks
+       // so their trxs are still available to undo.
        FC_ASSERT( !"TODO: implement pop_block" );
     }
 
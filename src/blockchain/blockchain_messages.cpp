@@ -12,5 +12,8 @@ const message_type get_trx_block_message::type = get_trx_block_msg;
 const message_type trxs_message::type = trxs_msg;
 const message_type full_block_message::type = full_block_msg;
 const message_type trx_block_message::type = trx_block_msg;
+const message_type block_not_available_message::type = block_not_available_msg;
+const message_type get_headers_message::type = get_headers_msg;
+const message_type headers_message::type = headers_msg;
 
 } } // bts::bitchat
@@ -6,7 +6,10 @@
 #include <bts/pts_address.hpp>
 #include <bts/bitcoin_wallet.hpp>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <set>
+#include <thread>
 #include <fc/exception/exception.hpp>
 #include <fc/filesystem.hpp>
 #include <fc/io/raw.hpp>
@@ -14,10 +17,19 @@
 #include <fc/log/logger.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/crypto/aes.hpp>
+#include <fc/thread/thread.hpp>
 #include <sstream>
 
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <cstdio>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace bts { namespace blockchain {
    /** 
@@ -103,6 +115,43 @@ FC_REFLECT( bts::blockchain::wallet_data,
             (transactions) 
             )
 
+namespace bts { namespace blockchain {
+   /**
+    *  Changes to wallet_data are appended to a journal next to the wallet file
+    *  rather than rewriting the whole wallet on every save.  The journal is
+    *  replayed on open and folded back into the wallet file once it grows
+    *  beyond max_wallet_journal_entries.
+    */
+   enum wallet_journal_entry_type
+   {
+      recv_address_entry     = 0, ///< std::pair<address,std::string>
+      recv_pts_address_entry = 1, ///< std::pair<pts_address,address>
+      send_address_entry     = 2, ///< std::pair<address,std::string>
+      encrypted_keys_entry   = 3, ///< std::vector<char>
+      last_used_key_entry    = 4, ///< uint32_t
+      transaction_entry      = 5  ///< transaction_state
+   };
+
+   struct wallet_journal_entry
+   {
+      wallet_journal_entry(){}
+
+      template<typename T>
+      wallet_journal_entry( wallet_journal_entry_type t, const T& v )
+      :type(t),data( fc::raw::pack(v) ){}
+
+      fc::enum_type<uint8_t,wallet_journal_entry_type> type;
+      std::vector<char>                                data;
+   };
+
+   const uint32_t max_wallet_journal_entries = 1024;
+} } // bts::blockchain
+
+FC_REFLECT_ENUM( bts::blockchain::wallet_journal_entry_type, 
+                 (recv_address_entry)(recv_pts_address_entry)(send_address_entry)
+                 (encrypted_keys_entry)(last_used_key_entry)(transaction_entry) )
+FC_REFLECT( bts::blockchain::wallet_journal_entry, (type)(data) )
+
 namespace bts { namespace blockchain {
   
    output_index::operator std::string()const
@@ -114,10 +163,144 @@ namespace bts { namespace blockchain {
 
    namespace detail 
    {
+      /** number of blocks fetched and matched together while scanning */
+      const uint32_t scan_batch_size = 64;
+
+      /**
+       *  A contiguous range of blocks read from the chain by wallet::scan_chain
+       */
+      struct scan_batch
+      {
+         std::vector<uint32_t>               block_trx_count;
+         std::vector<meta_trx>               trxs;
+         std::vector<transaction_id_type>    trx_ids;
+         std::vector<std::vector<uint16_t>>  matched_outputs; ///< per trx, outputs that belong to the wallet
+      };
+
+      std::shared_ptr<scan_batch> fetch_scan_batch( blockchain_db& chain, uint32_t first, uint32_t last )
+      {
+         auto batch = std::make_shared<scan_batch>();
+         for( uint32_t i = first; i <= last; ++i )
+         {
+            auto blk = chain.fetch_full_block( i );
+            bool pruned = chain.is_block_pruned( i );
+            batch->block_trx_count.push_back( blk.trx_ids.size() );
+            for( uint32_t trx_idx = 0; trx_idx < blk.trx_ids.size(); ++trx_idx )
+            {
+               trx_num tn( i, trx_idx );
+               if( pruned && !chain.has_trx( tn ) )
+               {
+                  // every output of a pruned trx was spent long ago, an empty trx keeps the indexes aligned
+                  batch->trxs.push_back( meta_trx() );
+                  continue;
+               }
+               batch->trxs.push_back( chain.fetch_trx( tn ) );
+            }
+         }
+         batch->trx_ids.resize( batch->trxs.size() );
+         batch->matched_outputs.resize( batch->trxs.size() );
+         return batch;
+      }
+
+      /** writes anything buffered for f through to the disk */
+      bool sync_file( FILE* f )
+      {
+         if( fflush( f ) != 0 ) return false;
+#ifdef WIN32
+         return _commit( _fileno( f ) ) == 0;
+#else
+         return fsync( fileno( f ) ) == 0;
+#endif
+      }
+
+      void sync_file( const fc::path& p )
+      {
+         FILE* f = fopen( p.to_native_ansi_path().c_str(), "ab" );
+         FC_ASSERT( f != nullptr, "unable to open ${p}", ("p",p) );
+         bool ok = sync_file( f );
+         fclose( f );
+         FC_ASSERT( ok, "unable to sync ${p}", ("p",p) );
+      }
+
+      /**
+       *  The receive addresses of a wallet.  Hash set lookups of the fixed size addresses
+       *  are already cheaper than a bloom filter probe, which packs and city hashes every 
+       *  output owner, so no prefilter is placed in front of them.
+       */
+      struct address_set
+      {
+         std::unordered_set<bts::address>      addresses;
+         std::unordered_set<bts::pts_address>  pts_addresses;
+
+         bool is_mine( const bts::address& a )const     { return addresses.find( a ) != addresses.end();         }
+         bool is_mine( const bts::pts_address& a )const { return pts_addresses.find( a ) != pts_addresses.end(); }
+
+         bool is_mine( const trx_output& out )const
+         {
+              switch( out.claim_func )
+              {
+                 case claim_by_pts:
+                    return is_mine( out.as<claim_by_pts_output>().owner );
+                 case claim_by_signature:
+                    return is_mine( out.as<claim_by_signature_output>().owner );
+                 case claim_by_bid:
+                    return is_mine( out.as<claim_by_bid_output>().pay_address );
+                 case claim_by_long:
+                    return is_mine( out.as<claim_by_long_output>().pay_address );
+                 case claim_by_cover:
+                    return is_mine( out.as<claim_by_cover_output>().owner );
+                 case null_claim_type:
+                 default:
+                    FC_ASSERT( !"Invalid Claim Type" );
+                    return false;
+              }
+         }
+      };
+
+      /**
+       *  Finds the outputs of batch.trxs[begin,end) that belong to addrs.  Only touches 
+       *  the batch and the address set so it may run on several threads at once for 
+       *  disjoint ranges.
+       */
+      void match_outputs( const address_set& addrs, scan_batch& batch, uint32_t begin, uint32_t end )
+      {
+           for( uint32_t i = begin; i < end; ++i )
+           {
+              const meta_trx& trx = batch.trxs[i];
+              batch.trx_ids[i] = trx.id();
+              for( uint16_t out_idx = 0; out_idx < trx.outputs.size(); ++out_idx )
+              {
+                 if( addrs.is_mine( trx.outputs[out_idx] ) )
+                 {
+                    batch.matched_outputs[i].push_back( out_idx );
+                 }
+              }
+           }
+      }
+
+      /** 
+       *  Threads shared by every wallet scan, the calling thread keeps reading blocks
+       *  while these match the previous batch.
+       */
+      std::vector<std::unique_ptr<fc::thread> >& scan_threads()
+      {
+         static std::vector<std::unique_ptr<fc::thread> > threads = []()
+         {
+            std::vector<std::unique_ptr<fc::thread> > result;
+            uint32_t num_threads = std::max<uint32_t>( std::thread::hardware_concurrency(), 1 );
+            for( uint32_t i = 0; i < num_threads; ++i )
+            {
+               result.emplace_back( new fc::thread( "wallet_scan" ) );
+            }
+            return result;
+         }();
+         return threads;
+      }
+
       class wallet_impl
       {
           public:
-              wallet_impl():_stake(0),_current_head_idx(0),_exception_on_open(false){}
+              wallet_impl():_stake(0),_current_head_idx(0),_exception_on_open(false),_journal_entry_count(0){}
               std::string _wallet_base_password; // used for saving/loading the wallet
               std::string _wallet_key_password;  // used to access private keys
 
@@ -128,6 +311,13 @@ namespace bts { namespace blockchain {
               uint32_t                                                   _current_head_idx;
               bool                                                       _exception_on_open;
 
+              /** changes to _data that have not yet been written to the journal */
+              std::vector<wallet_journal_entry>                          _pending_journal;
+              uint32_t                                                   _journal_entry_count;
+
+              /** see recv_address_set(), null until the first scan */
+              std::shared_ptr<address_set>                               _recv_address_set;
+
               std::map<output_index, output_reference>                   _output_index_to_ref;
               std::unordered_map<output_reference, output_index>         _output_ref_to_index;
 
@@ -135,27 +325,92 @@ namespace bts { namespace blockchain {
               std::map<output_index, trx_output>                         _unspent_outputs;
               std::map<output_index, trx_output>                         _spent_outputs;
 
+              /**
+               *  Secondary indexes over _unspent_outputs, maintained by insert_unspent and
+               *  erase_unspent.  Spendable outputs are those claimable by signature or pts.
+               */
+              std::map<claim_type_enum, std::set<output_index> >                        _unspent_by_claim;
+              std::map<asset::type, std::set<output_index> >                            _spendable_by_age;
+              std::map<asset::type, std::multimap<fc::uint128, output_index> >          _spendable_by_amount;
+              std::map<asset::type, asset>                                              _spendable_balance;
+
               // maps address to private key index
               std::unordered_map<bts::address,fc::ecc::private_key>      _my_keys;
               std::unordered_map<transaction_id_type,signed_transaction> _id_to_signed_transaction;
 
+              static bool is_spendable( const trx_output& out )
+              {
+                   return out.claim_func == claim_by_signature || out.claim_func == claim_by_pts;
+              }
+
+              void insert_unspent( const output_index& idx, const trx_output& out )
+              {
+                   auto itr = _unspent_outputs.find( idx );
+                   if( itr != _unspent_outputs.end() )
+                   {
+                      erase_unspent( itr );
+                   }
+                   _unspent_outputs[idx] = out;
+                   _unspent_by_claim[out.claim_func].insert( idx );
+                   if( is_spendable( out ) )
+                   {
+                      auto unit = out.amount.unit;
+                      _spendable_by_age[unit].insert( idx );
+                      _spendable_by_amount[unit].insert( std::make_pair( out.amount.amount, idx ) );
+                      auto bal = _spendable_balance.find( unit );
+                      if( bal == _spendable_balance.end() )
+                      {
+                         _spendable_balance[unit] = out.amount;
+                      }
+                      else
+                      {
+                         bal->second += out.amount;
+                      }
+                   }
+              }
+
+              void erase_unspent( std::map<output_index,trx_output>::iterator itr )
+              {
+                   const output_index idx = itr->first;
+                   const trx_output&  out = itr->second;
+                   _unspent_by_claim[out.claim_func].erase( idx );
+                   if( is_spendable( out ) )
+                   {
+                      auto unit = out.amount.unit;
+                      _spendable_by_age[unit].erase( idx );
+                      auto& by_amount = _spendable_by_amount[unit];
+                      auto range = by_amount.equal_range( out.amount.amount );
+                      for( auto aitr = range.first; aitr != range.second; ++aitr )
+                      {
+                         if( aitr->second == idx )
+                         {
+                            by_amount.erase( aitr );
+                            break;
+                         }
+                      }
+                      _spendable_balance[unit] = _spendable_balance[unit] - out.amount;
+                   }
+                   _unspent_outputs.erase( itr );
+              }
+
               asset get_balance( asset::type balance_type )
               {
-                   asset total_bal( static_cast<uint64_t>(0ull), balance_type);
-                   std::vector<trx_input> inputs;
-                   for( auto itr = _unspent_outputs.begin(); itr != _unspent_outputs.end(); ++itr )
+                   auto itr = _spendable_balance.find( balance_type );
+                   if( itr == _spendable_balance.end() )
                    {
-                      //ilog( "unspent outputs ${o}", ("o",*itr) );
-                       if( itr->second.claim_func == claim_by_signature && itr->second.amount.unit == balance_type )
-                       {
-                           total_bal += itr->second.amount; // TODO: apply interest earned 
-                       }
-                       if( itr->second.claim_func == claim_by_pts && itr->second.amount.unit == balance_type )
-                       {
-                           total_bal += itr->second.amount; // TODO: apply interest earned 
-                       }
+                      return asset( static_cast<uint64_t>(0ull), balance_type );
+                   }
+                   return itr->second; // TODO: apply interest earned 
+              }
+
+              /** returns the address that must sign to spend a spendable output */
+              bts::address get_spend_address( const trx_output& out )
+              {
+                   if( out.claim_func == claim_by_pts )
+                   {
+                      return _data.recv_pts_addresses[out.as<claim_by_pts_output>().owner];
                    }
-                   return total_bal;
+                   return out.as<claim_by_signature_output>().owner;
               }
 
               std::vector<trx_input> collect_coindays( uint64_t request_cdd, asset& total_in, 
@@ -164,74 +419,64 @@ namespace bts { namespace blockchain {
                    FC_ASSERT( _current_head_idx > 0 );
                    provided_cdd = 0;
                    std::vector<trx_input> inputs;
-                   for( auto itr = _unspent_outputs.begin(); itr != _unspent_outputs.end(); ++itr )
+                   const auto& by_age = _spendable_by_age[asset::bts];
+                   for( auto itr = by_age.begin(); itr != by_age.end(); ++itr )
                    {
-                       ilog( "unspent outputs ${o}", ("o",*itr) );
-                       if( itr->second.claim_func == claim_by_signature && itr->second.amount.unit == asset::bts )
-                       {
-                           inputs.push_back( trx_input( _output_index_to_ref[itr->first] ) );
-                           total_in += itr->second.amount;
-                           auto cdd = itr->second.amount.get_rounded_amount() * (_current_head_idx - itr->first.block_idx);
-                           if( cdd > 0 ) 
-                           {
-                              provided_cdd += cdd;
-                              req_sigs.insert( itr->second.as<claim_by_signature_output>().owner );
-                             // ilog( "total in ${in}  min ${min}", ( "in",total_in)("min",min_amnt) );
-                              if( provided_cdd >= request_cdd )
-                              {
-                                 return inputs;
-                              }
-                           }
-                       }
-                       else if( itr->second.claim_func == claim_by_pts && itr->second.amount.unit == asset::bts )
+                       const trx_output& out = _unspent_outputs[*itr];
+                       ilog( "unspent outputs ${o}", ("o",out) );
+                       inputs.push_back( trx_input( _output_index_to_ref[*itr] ) );
+                       total_in += out.amount;
+                       auto cdd = out.amount.get_rounded_amount() * (_current_head_idx - itr->block_idx);
+                       if( cdd > 0 ) 
                        {
-                           inputs.push_back( trx_input( _output_index_to_ref[itr->first] ) );
-                           total_in += itr->second.amount;
-                           auto cdd = itr->second.amount.get_rounded_amount() * (_current_head_idx - itr->first.block_idx);
-                           if( cdd > 0 ) 
-                           {
-                              provided_cdd += cdd;
-                              req_sigs.insert( _data.recv_pts_addresses[itr->second.as<claim_by_pts_output>().owner] );
-                              if( provided_cdd >= request_cdd )
-                              {
-                                 return inputs;
-                              }
-                           }
+                          provided_cdd += cdd;
+                          req_sigs.insert( get_spend_address( out ) );
+                          if( provided_cdd >= request_cdd )
+                          {
+                             return inputs;
+                          }
                        }
                    }
                    return inputs;
               }
 
               /**
-               *  Collect inputs that total to at least min_amnt.
+               *  Collect inputs that total to at least min_amnt using as few outputs as
+               *  possible:  the smallest single output that covers min_amnt if there is
+               *  one, otherwise the largest outputs until min_amnt is reached.
                */
               std::vector<trx_input> collect_inputs( const asset& min_amnt, asset& total_in, std::unordered_set<bts::address>& req_sigs )
               {
                    std::vector<trx_input> inputs;
-                   for( auto itr = _unspent_outputs.begin(); itr != _unspent_outputs.end(); ++itr )
+                   const auto& by_amount = _spendable_by_amount[min_amnt.unit];
+
+                   auto collect = [&]( const output_index& idx ) -> bool
                    {
-                      ilog( "unspent outputs ${o}", ("o",*itr) );
-                       if( itr->second.claim_func == claim_by_signature && itr->second.amount.unit == min_amnt.unit )
+                       const trx_output& out = _unspent_outputs[idx];
+                       inputs.push_back( trx_input( _output_index_to_ref[idx] ) );
+                       total_in += out.amount;
+                       req_sigs.insert( get_spend_address( out ) );
+                       ilog( "total in ${in}  min ${min}", ( "in",total_in)("min",min_amnt) );
+                       return total_in.get_rounded_amount() >= min_amnt.get_rounded_amount();
+                   };
+
+                   auto single = by_amount.lower_bound( min_amnt.amount );
+                   if( single != by_amount.end() )
+                   {
+                       if( collect( single->second ) )
                        {
-                           inputs.push_back( trx_input( _output_index_to_ref[itr->first] ) );
-                           total_in += itr->second.amount;
-                           req_sigs.insert( itr->second.as<claim_by_signature_output>().owner );
-                           ilog( "total in ${in}  min ${min}", ( "in",total_in)("min",min_amnt) );
-                           if( total_in.get_rounded_amount() >= min_amnt.get_rounded_amount() )
-                           {
-                              return inputs;
-                           }
+                          return inputs;
                        }
-                       else if( itr->second.claim_func == claim_by_pts && itr->second.amount.unit == min_amnt.unit )
+                   }
+                   for( auto ritr = by_amount.rbegin(); ritr != by_amount.rend(); ++ritr )
+                   {
+                       if( single != by_amount.end() && ritr->second == single->second )
                        {
-                           inputs.push_back( trx_input( _output_index_to_ref[itr->first] ) );
-                           total_in += itr->second.amount;
-                           req_sigs.insert( _data.recv_pts_addresses[itr->second.as<claim_by_pts_output>().owner] );
-                           ilog( "total in ${in}  min ${min}", ( "in",total_in)("min",min_amnt) );
-                           if( total_in.get_rounded_amount() >= min_amnt.get_rounded_amount() )
-                           {
-                              return inputs;
-                           }
+                          continue; // already collected above
+                       }
+                       if( collect( ritr->second ) )
+                       {
+                          return inputs;
                        }
                    }
                    FC_ASSERT( false, "Unable to collect sufficient unspent inputs", ("min_amnt",min_amnt)("total_collected",total_in) );
@@ -240,17 +485,15 @@ namespace bts { namespace blockchain {
               asset get_margin_balance( asset::type unit, asset& total_collat )
               {
                    asset total_due( static_cast<uint64_t>(0ull), unit );
-                   std::multimap<price,trx_input> inputs;
-                   for( auto itr = _unspent_outputs.begin(); itr != _unspent_outputs.end(); ++itr )
+                   const auto& covers = _unspent_by_claim[claim_by_cover];
+                   for( auto itr = covers.begin(); itr != covers.end(); ++itr )
                    {
-                       if( itr->second.claim_func == claim_by_cover )
+                       const trx_output& out = _unspent_outputs[*itr];
+                       auto cbc = out.as<claim_by_cover_output>();
+                       if( cbc.payoff.unit == unit )
                        {
-                           auto cbc = itr->second.as<claim_by_cover_output>();
-                           if( cbc.payoff.unit == unit )
-                           {
-                              total_due += cbc.payoff; 
-                              total_collat += itr->second.amount;
-                           }
+                          total_due += cbc.payoff; 
+                          total_collat += out.amount;
                        }
                    }
                    return total_due;
@@ -265,17 +508,15 @@ namespace bts { namespace blockchain {
                                                            std::unordered_set<bts::address>& req_sigs )
               {
                    std::multimap<price,trx_input> inputs;
-                   for( auto itr = _unspent_outputs.begin(); itr != _unspent_outputs.end(); ++itr )
+                   const auto& covers = _unspent_by_claim[claim_by_cover];
+                   for( auto itr = covers.begin(); itr != covers.end(); ++itr )
                    {
-                       if( itr->second.claim_func == claim_by_cover )
+                       const trx_output& out = _unspent_outputs[*itr];
+                       auto cbc = out.as<claim_by_cover_output>();
+                       if( cbc.payoff.unit == min_amnt.unit )
                        {
-                           auto cbc = itr->second.as<claim_by_cover_output>();
-                           if( cbc.payoff.unit == min_amnt.unit )
-                           {
-                              //asset payoff( cbc.payoff_amount, min_amnt.unit );
-                              inputs.insert( std::pair<price,trx_input>( cbc.payoff / itr->second.amount, trx_input( _output_index_to_ref[itr->first] )  ) );
-
-                           }
+                          //asset payoff( cbc.payoff_amount, min_amnt.unit );
+                          inputs.insert( std::pair<price,trx_input>( cbc.payoff / out.amount, trx_input( _output_index_to_ref[*itr] )  ) );
                        }
                    }
 
@@ -328,10 +569,252 @@ namespace bts { namespace blockchain {
                           elog( "MARK AS SPENT ${B}", ("B",itr->output_ref) );
                           self->mark_as_spent( itr->output_ref );
                       }
-                      _data.transactions[trx.id()].trx = trx;
+                      auto& state = _data.transactions[trx.id()];
+                      state.trx = trx;
+                      journal( wallet_journal_entry( transaction_entry, state ) );
+                   }
+              }
+              /**
+               *  @return the receive addresses, built once and then kept up to date as 
+               *  addresses are added.  The set is never modified while scan threads hold 
+               *  a reference to it, so it may be matched against on other threads while 
+               *  this wallet is modified by tasks on its own thread.
+               */
+              std::shared_ptr<const address_set> recv_address_set()
+              {
+                   if( !_recv_address_set )
+                   {
+                      _recv_address_set = std::make_shared<address_set>();
+                      for( auto itr = _data.recv_addresses.begin(); itr != _data.recv_addresses.end(); ++itr )
+                      {
+                         _recv_address_set->addresses.insert( itr->first );
+                      }
+                      for( auto itr = _data.recv_pts_addresses.begin(); itr != _data.recv_pts_addresses.end(); ++itr )
+                      {
+                         _recv_address_set->pts_addresses.insert( itr->first );
+                      }
+                   }
+                   return _recv_address_set;
+              }
+
+              /** copies the address set first if a scan still holds it */
+              address_set& modify_recv_address_set()
+              {
+                   if( !_recv_address_set.unique() )
+                   {
+                      _recv_address_set = std::make_shared<address_set>( *_recv_address_set );
+                   }
+                   return *_recv_address_set;
+              }
+
+              void add_recv_address( const bts::address& addr, const std::string& label )
+              {
+                   _data.recv_addresses[addr] = label;
+                   if( _recv_address_set ) modify_recv_address_set().addresses.insert( addr );
+              }
+
+              void add_recv_pts_address( const bts::pts_address& pts_addr, const bts::address& addr )
+              {
+                   _data.recv_pts_addresses[pts_addr] = addr;
+                   if( _recv_address_set ) modify_recv_address_set().pts_addresses.insert( pts_addr );
+              }
+
+              /**
+               *  Records an output that belongs to this wallet as either unspent or spent.
+               */
+              void apply_output( const meta_trx& trx, const transaction_id_type& trx_id, const output_index& oidx )
+              {
+                   const output_reference out_ref( trx_id, oidx.output_idx );
+                   if( !trx.meta_outputs[oidx.output_idx].is_spent() )
+                   {
+                      if( trx.outputs[oidx.output_idx].claim_func == claim_by_cover )
+                      {
+                         elog( "UNSPENT COVER DISCOVERED ${B}", ("B",out_ref) );
+                      }
+                      _output_index_to_ref[oidx]    = out_ref;
+                      _output_ref_to_index[out_ref] = oidx;
+                      insert_unspent( oidx, trx.outputs[oidx.output_idx] );
+                   }
+                   else
+                   {
+                      self->mark_as_spent( out_ref );
                    }
               }
+
               wallet* self;
+
+              fc::path journal_path()const
+              {
+                   return fc::path( _wallet_dat.generic_string() + ".journal" );
+              }
+
+              fc::sha512 journal_key()const
+              {
+                   return fc::sha512::hash( _wallet_base_password.c_str(), _wallet_base_password.size() );
+              }
+
+              void journal( const wallet_journal_entry& e )
+              {
+                   _pending_journal.push_back( e );
+              }
+
+              void apply_journal_entry( const wallet_journal_entry& e )
+              {
+                   switch( e.type )
+                   {
+                      case recv_address_entry:
+                      {
+                         auto v = fc::raw::unpack<std::pair<bts::address,std::string>>( e.data );
+                         add_recv_address( v.first, v.second );
+                         break;
+                      }
+                      case recv_pts_address_entry:
+                      {
+                         auto v = fc::raw::unpack<std::pair<bts::pts_address,bts::address>>( e.data );
+                         add_recv_pts_address( v.first, v.second );
+                         break;
+                      }
+                      case send_address_entry:
+                      {
+                         auto v = fc::raw::unpack<std::pair<bts::address,std::string>>( e.data );
+                         _data.send_addresses[v.first] = v.second;
+                         break;
+                      }
+                      case encrypted_keys_entry:
+                         _data.encrypted_keys = fc::raw::unpack<std::vector<char>>( e.data );
+                         break;
+                      case last_used_key_entry:
+                         _data.last_used_key = fc::raw::unpack<uint32_t>( e.data );
+                         break;
+                      case transaction_entry:
+                      {
+                         auto v = fc::raw::unpack<transaction_state>( e.data );
+                         _data.transactions[v.trx.id()] = v;
+                         break;
+                      }
+                      default:
+                         FC_THROW_EXCEPTION( fc::exception, "unknown wallet journal entry type ${t}", ("t",e.type) );
+                   }
+              }
+
+              /**
+               *  Each record is a 32 bit length followed by the packed (and encrypted if the
+               *  wallet has a password) wallet_journal_entry.  A truncated record at the end
+               *  of the file is the result of an interrupted append and is ignored, as is a
+               *  length that runs past the end of the file.
+               */
+              void replay_journal()
+              { try {
+                   _journal_entry_count = 0;
+                   auto jpath = journal_path();
+                   if( !fc::exists( jpath ) )
+                   {
+                      return;
+                   }
+                   uint64_t remaining = fc::file_size( jpath );
+                   std::ifstream in( jpath.to_native_ansi_path().c_str(), std::ios::in | std::ios::binary );
+                   while( in.good() )
+                   {
+                      uint32_t record_size = 0;
+                      in.read( (char*)&record_size, sizeof(record_size) );
+                      if( in.gcount() != sizeof(record_size) ) 
+                      {
+                         break;
+                      }
+                      remaining -= sizeof(record_size);
+                      if( record_size > remaining )
+                      {
+                         wlog( "ignoring truncated wallet journal record of ${s} bytes", ("s",record_size) );
+                         break;
+                      }
+                      std::vector<char> record(record_size);
+                      in.read( record.data(), record_size );
+                      if( uint32_t(in.gcount()) != record_size )
+                      {
+                         wlog( "ignoring truncated wallet journal record" );
+                         break;
+                      }
+                      remaining -= record_size;
+                      if( _wallet_base_password.size() )
+                      {
+                         record = fc::aes_decrypt( journal_key(), record );
+                      }
+                      apply_journal_entry( fc::raw::unpack<wallet_journal_entry>( record ) );
+                      ++_journal_entry_count;
+                   }
+              } FC_RETHROW_EXCEPTIONS( warn, "unable to replay wallet journal" ) }
+
+              /**
+               *  Appends the pending entries and syncs the journal to disk before returning
+               *  so that a crash can at most lose the record being written.
+               */
+              void append_journal()
+              { try {
+                   if( _pending_journal.size() == 0 )
+                   {
+                      return;
+                   }
+                   std::vector<char> data;
+                   for( auto itr = _pending_journal.begin(); itr != _pending_journal.end(); ++itr )
+                   {
+                      auto record = fc::raw::pack( *itr );
+                      if( _wallet_base_password.size() )
+                      {
+                         record = fc::aes_encrypt( journal_key(), record );
+                      }
+                      uint32_t record_size = record.size();
+                      data.insert( data.end(), (const char*)&record_size, (const char*)&record_size + sizeof(record_size) );
+                      data.insert( data.end(), record.begin(), record.end() );
+                   }
+
+                   FILE* out = fopen( journal_path().to_native_ansi_path().c_str(), "ab" );
+                   FC_ASSERT( out != nullptr );
+                   bool ok = fwrite( data.data(), 1, data.size(), out ) == data.size() && sync_file( out );
+                   fclose( out );
+                   FC_ASSERT( ok );
+
+                   _journal_entry_count += _pending_journal.size();
+                   _pending_journal.clear();
+              } FC_RETHROW_EXCEPTIONS( warn, "unable to append to wallet journal ${j}", ("j",journal_path()) ) }
+
+              /**
+               *  Writes all of _data to wallet_file, replacing any existing file.
+               */
+              void save_full( const fc::path& wallet_file )
+              {
+                   auto wallet_json = fc::json::to_pretty_string( _data );
+                   std::vector<char> data( wallet_json.begin(), wallet_json.end() );
+
+                   if( fc::exists( wallet_file ) )
+                   {
+                     auto new_tmp = fc::unique_path();
+                     auto old_tmp = fc::unique_path();
+                     if( _wallet_base_password.size() )
+                     {
+                       fc::aes_save( new_tmp, journal_key(), data );
+                     }
+                     else
+                     {
+                        fc::json::save_to_file( _data, new_tmp, true );
+                     }
+                     sync_file( new_tmp );
+                     fc::rename( wallet_file, old_tmp );
+                     fc::rename( new_tmp, wallet_file );
+                     fc::remove( old_tmp );
+                   }
+                   else
+                   {
+                      if( _wallet_base_password.size() != 0 )
+                      {
+                         fc::aes_save( wallet_file, journal_key(), data );
+                      }
+                      else
+                      {
+                         fc::json::save_to_file( _data, wallet_file, true );
+                      }
+                      sync_file( wallet_file );
+                   }
+              }
       };
    } // namespace detail
 
@@ -371,6 +854,9 @@ namespace bts { namespace blockchain {
                std::string str( plain_txt.begin(), plain_txt.end() );
                my->_data = fc::json::from_string(str).as<wallet_data>();
            }
+           my->_recv_address_set.reset();
+           my->_pending_journal.clear();
+           my->replay_journal();
        }catch( fc::exception& er ) {
            my->_exception_on_open = true;
            FC_RETHROW_EXCEPTION( er, warn, "unable to load ${wal}", ("wal",wallet_dat) );
@@ -393,11 +879,20 @@ namespace bts { namespace blockchain {
       FC_ASSERT( key_password.size() >= 8 );
 
       my->_data = wallet_data();
+      my->_recv_address_set.reset();
 
       my->_wallet_dat = wallet_dat;
       my->_wallet_base_password = base_password;
       my->_wallet_key_password  = key_password;
       my->_exception_on_open = false;
+
+      // a journal left behind by a deleted wallet must not be replayed into this one
+      if( fc::exists( my->journal_path() ) )
+      {
+         fc::remove( my->journal_path() );
+      }
+      my->_pending_journal.clear();
+      my->_journal_entry_count = 0;
       
       if( is_brain )
       {
@@ -417,17 +912,8 @@ namespace bts { namespace blockchain {
    void wallet::backup_wallet( const fc::path& backup_path )
    { try {
       FC_ASSERT( !fc::exists( backup_path ) );
-      auto tmp = my->_wallet_dat;
-      my->_wallet_dat = backup_path;
-      try {
-        save();
-        my->_wallet_dat = tmp;
-      } 
-      catch ( ... )
-      {
-        my->_wallet_dat = tmp;
-        throw;
-      }
+      // _data already includes everything in the journal
+      my->save_full( backup_path );
    } FC_RETHROW_EXCEPTIONS( warn, "unable to backup to ${path}", ("path",backup_path) ) }
 
    /**
@@ -442,48 +928,43 @@ namespace bts { namespace blockchain {
       {
          auto pts_key = bts::pts_address( key.get_public_key(), false, 0 );
          import_key( key, std::string( pts_key ) );
-         my->_data.recv_pts_addresses[ bts::pts_address( key.get_public_key() ) ]           = bts::address( key.get_public_key() );
-         my->_data.recv_pts_addresses[ bts::pts_address( key.get_public_key(), false, 0 ) ] = bts::address( key.get_public_key() );
-         my->_data.recv_pts_addresses[ bts::pts_address( key.get_public_key(), true, 0 ) ]  = bts::address( key.get_public_key() );
+         bts::pts_address pts_addrs[] = { bts::pts_address( key.get_public_key() ),
+                                           bts::pts_address( key.get_public_key(), false, 0 ),
+                                           bts::pts_address( key.get_public_key(), true, 0 ) };
+         for( const auto& pts_addr : pts_addrs )
+         {
+            my->add_recv_pts_address( pts_addr, bts::address( key.get_public_key() ) );
+            my->journal( wallet_journal_entry( recv_pts_address_entry, std::make_pair( pts_addr, bts::address( key.get_public_key() ) ) ) );
+         }
       }
+      save();
    } FC_RETHROW_EXCEPTIONS( warn, "Unable to import bitcoin wallet ${wallet_dat}", ("wallet_dat",wallet_dat) ) }
 
 
+   /**
+    *  Appends any pending changes to the journal, the full wallet is only rewritten
+    *  when it does not exist yet or the journal has grown too large.
+    */
    void wallet::save()
    { try {
       ilog( "saving wallet\n" );
       if(my->_exception_on_open)
           return;
 
-      auto wallet_json = fc::json::to_pretty_string( my->_data );
-      std::vector<char> data( wallet_json.begin(), wallet_json.end() );
-
-      if( fc::exists( my->_wallet_dat ) )
+      if( !fc::exists( my->_wallet_dat ) || 
+          my->_journal_entry_count + my->_pending_journal.size() > max_wallet_journal_entries )
       {
-        auto new_tmp = fc::unique_path();
-        auto old_tmp = fc::unique_path();
-        if( my->_wallet_base_password.size() )
-        {
-          fc::aes_save( new_tmp, fc::sha512::hash( my->_wallet_base_password.c_str(), my->_wallet_base_password.size() ), data );
-        }
-        else
-        {
-           fc::json::save_to_file( my->_data, new_tmp, true );
-        }
-        fc::rename( my->_wallet_dat, old_tmp );
-        fc::rename( new_tmp, my->_wallet_dat );
-        fc::remove( old_tmp );
+         my->save_full( my->_wallet_dat );
+         if( fc::exists( my->journal_path() ) )
+         {
+            fc::remove( my->journal_path() );
+         }
+         my->_pending_journal.clear();
+         my->_journal_entry_count = 0;
       }
       else
       {
-         if( my->_wallet_base_password.size() != 0 )
-         {
-            fc::aes_save( my->_wallet_dat, fc::sha512::hash( my->_wallet_base_password.c_str(), my->_wallet_base_password.size() ), data );
-         }
-         else
-         {
-            fc::json::save_to_file( my->_data, my->_wallet_dat, true );
-         }
+         my->append_journal();
       }
    } FC_RETHROW_EXCEPTIONS( warn, "Unable to save wallet ${wallet}", ("wallet",my->_wallet_dat) ) }
 
@@ -510,7 +991,9 @@ namespace bts { namespace blockchain {
       auto addr = bts::address(key.get_public_key());
       keys[addr] = key;
       my->_data.set_keys( keys, my->_wallet_key_password );
-      my->_data.recv_addresses[addr] = label;
+      my->add_recv_address( addr, label );
+      my->journal( wallet_journal_entry( encrypted_keys_entry, my->_data.encrypted_keys ) );
+      my->journal( wallet_journal_entry( recv_address_entry, std::make_pair( addr, label ) ) );
       save();
       return addr;
    } FC_RETHROW_EXCEPTIONS( warn, "unable to import private key" ) }
@@ -519,6 +1002,7 @@ namespace bts { namespace blockchain {
    { try {
       FC_ASSERT( !is_locked() );
       my->_data.last_used_key++;
+      my->journal( wallet_journal_entry( last_used_key_entry, my->_data.last_used_key ) );
       auto base_key = my->_data.get_base_key( my->_wallet_key_password );
       auto new_key = base_key.child( my->_data.last_used_key );
       return import_key(new_key, label);
@@ -527,6 +1011,7 @@ namespace bts { namespace blockchain {
    void wallet::add_send_address( const bts::address& addr, const std::string& label )
    { try {
       my->_data.send_addresses[addr] = label;
+      my->journal( wallet_journal_entry( send_address_entry, std::make_pair( addr, label ) ) );
       save();
    } FC_RETHROW_EXCEPTIONS( warn, "unable to add send address ${addr} with label ${label}", ("addr",addr)("label",label) ) }
 
@@ -549,9 +1034,13 @@ namespace bts { namespace blockchain {
       my->_data.get_base_key( key_password );
       my->_wallet_key_password = key_password;
    } FC_RETHROW_EXCEPTIONS( warn, "unable to unlock wallet" ) }
+   /**
+    *  Forgets the key password, the base password is kept because it encrypts the
+    *  wallet file and its journal.
+    */
    void                  wallet::lock_wallet()
    {
-      my->_wallet_base_password = std::string();
+      my->_wallet_key_password = std::string();
    }
    bool   wallet::is_locked()const { return my->_wallet_key_password.size() == 0; }
 
@@ -656,7 +1145,7 @@ namespace bts { namespace blockchain {
           return;
       }
       my->_spent_outputs[ref_itr->second] = itr->second;
-      my->_unspent_outputs.erase(ref_itr->second);      
+      my->erase_unspent( itr );
    }
 
    void wallet::sign_transaction( signed_transaction& trx, const bts::address& addr )
@@ -1047,177 +1536,97 @@ namespace bts { namespace blockchain {
     *  Scan the blockchain starting from_block_num until the head block, check every
     *  transaction for inputs or outputs accessable by this wallet.
     *
+    *  The scan is a three stage pipeline:  while the scan threads match the current 
+    *  batch of blocks against the wallet address set, the calling thread 
+    *  reads the next batch from the chain, the matches are then applied to the wallet 
+    *  in chain order on the calling thread.  The chain and the wallet are only touched 
+    *  by the calling thread.  Short scans (ie: a single new block) are performed inline.
+    *
     *  @return true if a new input was found or output spent
     */
    bool wallet::scan_chain( blockchain_db& chain, uint32_t from_block_num, scan_progress_callback cb )
    { try {
        bool found = false;
        auto head_block_num = chain.head_block_num();
-   //    ilog( "receive pts addr: ${recv_pts_addrs}", ("recv_pts_addrs",my->_data.recv_pts_addresses) );
-       // for each block
-       for( uint32_t i = from_block_num; i <= head_block_num; ++i )
+       if( head_block_num == INVALID_BLOCK_NUM || from_block_num > head_block_num )
        {
-       //   ilog( "block: ${i}", ("i",i ) );
-          auto blk = chain.fetch_full_block( i );
-          // for each transaction
-          for( uint32_t trx_idx = 0; trx_idx < blk.trx_ids.size(); ++trx_idx )
-          {
-              if( cb ) cb( i, head_block_num, trx_idx, blk.trx_ids.size() ); 
+          return found;
+       }
+   //    ilog( "receive pts addr: ${recv_pts_addrs}", ("recv_pts_addrs",my->_data.recv_pts_addresses) );
+       std::shared_ptr<const detail::address_set> addrs = my->recv_address_set();
 
-              //ilog( "trx: ${trx_idx}", ("trx_idx",trx_idx ) );
-              auto trx = chain.fetch_trx( trx_num( i, trx_idx ) ); //blk.trx_ids[trx_idx] );
-              //ilog( "${id} \n\n  ${trx}\n\n", ("id",trx.id())("trx",trx) );
+       const bool parallel = (head_block_num - from_block_num) >= detail::scan_batch_size;
 
-              for( uint32_t in_idx = 0; in_idx < trx.inputs.size(); ++in_idx )
-              {
-                  mark_as_spent( trx.inputs[in_idx].output_ref );
-              }
+       auto fetch = [&chain,head_block_num]( uint32_t first ) -> std::shared_ptr<detail::scan_batch>
+       {
+          auto last = std::min<uint32_t>( first + detail::scan_batch_size - 1, head_block_num );
+          return detail::fetch_scan_batch( chain, first, last );
+       };
 
-              // for each output
-              for( uint32_t out_idx = 0; out_idx < trx.outputs.size(); ++out_idx )
-              {
-                  const trx_output& out   = trx.outputs[out_idx];
-                  const output_reference  out_ref( trx.id(),out_idx );
-                  const output_index      oidx( i, trx_idx, out_idx );
-                  switch( out.claim_func )
-                  {
-                     case claim_by_pts:
-                     {
-                        auto owner = out.as<claim_by_pts_output>().owner;
-                        auto aitr  = my->_data.recv_pts_addresses.find(owner); //my_addresses.find(owner);
-                        if( aitr != my->_data.recv_pts_addresses.end() )
-                        {
-                            if( !trx.meta_outputs[out_idx].is_spent() )
-                            {
-                               my->_output_index_to_ref[oidx]    = out_ref;
-                               my->_output_ref_to_index[out_ref] = oidx;
-                               my->_unspent_outputs[oidx] = trx.outputs[out_idx];
-                            }
-                            else
-                            {
-                               mark_as_spent( out_ref ); //output_reference(trx.id(), out_idx ) );
-                               //my->_spent_outputs[output_reference( trx.id(), out_idx )] = trx.outputs[out_idx];
-                            }
-                           // std::cerr<<"found block["<<i<<"].trx["<<trx_idx<<"].output["<<out_idx<<"]  " << std::string(trx.id()) <<" => "<<std::string(owner)<<"\n";
-                           found = true;
-                        }
-                        break;
-                     }
-                     case claim_by_signature:
-                     {
-                        auto owner = out.as<claim_by_signature_output>().owner;
-                        auto aitr  = my->_data.recv_addresses.find(owner); //my_addresses.find(owner);
-                        if( aitr != my->_data.recv_addresses.end() )
-                        {
-                            if( !trx.meta_outputs[out_idx].is_spent() )
-                            {
-                               my->_output_index_to_ref[oidx]    = out_ref;
-                               my->_output_ref_to_index[out_ref] = oidx;
-                               my->_unspent_outputs[oidx] = trx.outputs[out_idx];
-                            }
-                            else
-                            {
-                               mark_as_spent( out_ref ); //output_reference(trx.id(), out_idx ) );
-                               //my->_spent_outputs[output_reference( trx.id(), out_idx )] = trx.outputs[out_idx];
-                            }
-                           // std::cerr<<"found block["<<i<<"].trx["<<trx_idx<<"].output["<<out_idx<<"]  " << std::string(trx.id()) <<" => "<<std::string(owner)<<"\n";
-                           found = true;
-                        }
-                        else
-                        {
-                            // std::cerr<<"skip block["<<i<<"].trx["<<trx_idx<<"].output["<<out_idx<<"] => "<<std::string(owner)<<"\n";
-                        }
-                        break;
-                     }
-                     case claim_by_bid:
-                     {
-                        auto bid = out.as<claim_by_bid_output>();
-                        auto aitr = my->_data.recv_addresses.find(bid.pay_address);
-                        if( aitr != my->_data.recv_addresses.end() )
-                        {
-                            found = true;
-                            if( trx.meta_outputs[out_idx].is_spent() )
-                            {
-                               mark_as_spent( out_ref );
-                               //my->_unspent_outputs.erase(out_ref);
-                              // my->_spent_outputs[out_ref] = trx.outputs[out_idx];
-                            }
-                            else
-                            {
-                               //my->_unspent_outputs[out_ref] = trx.outputs[out_idx];
-                               my->_output_index_to_ref[oidx]    = out_ref;
-                               my->_output_ref_to_index[out_ref] = oidx;
-                               my->_unspent_outputs[oidx] = trx.outputs[out_idx];
-                            }
-                        }
-                        else
-                        {
-                           // skip, it doesn't belong to me
-                        }
-                        break;
-                     }
-                     case claim_by_long:
-                     {
-                        auto short_sell = out.as<claim_by_long_output>();
-                        auto aitr = my->_data.recv_addresses.find(short_sell.pay_address);
-                        if( aitr != my->_data.recv_addresses.end() )
-                        {
-                            found = true;
-                            if( trx.meta_outputs[out_idx].is_spent() )
-                            {
-                               mark_as_spent( out_ref );
-                             //  my->_unspent_outputs.erase(out_ref);
-                             //  my->_spent_outputs[out_ref] = trx.outputs[out_idx];
-                            }
-                            else
-                            {
-                               my->_output_index_to_ref[oidx]    = out_ref;
-                               my->_output_ref_to_index[out_ref] = oidx;
-                               my->_unspent_outputs[oidx] = trx.outputs[out_idx];
-                            }
-                        }
-                        else
-                        {
-                           // skip, it doesn't belong to me
-                        }
-                        break;
-                     }
-                     case claim_by_cover:
-                     {
-                        auto cover = out.as<claim_by_cover_output>();
-                        auto aitr = my->_data.recv_addresses.find(cover.owner);
-                        if( aitr != my->_data.recv_addresses.end() )
-                        {
-                            found = true;
-                            if( trx.meta_outputs[out_idx].is_spent() )
-                            {
-                               mark_as_spent( out_ref );
-                               //my->_unspent_outputs.erase(out_ref);
-                               //my->_spent_outputs[out_ref] = trx.outputs[out_idx];
-                            }
-                            else
-                            {
-                               elog( "UNSPENT COVER DISCOVERED ${B}", ("B",out_ref) );
-                               //my->_unspent_outputs[out_ref] = trx.outputs[out_idx];
-                               my->_output_index_to_ref[oidx]    = out_ref;
-                               my->_output_ref_to_index[out_ref] = oidx;
-                               my->_unspent_outputs[oidx] = trx.outputs[out_idx];
-                            }
-                        }
-                        else
-                        {
-                           // skip, it doesn't belong to me
-                        }
-                        break;
-                     }
+       uint32_t first = from_block_num;
+       std::shared_ptr<detail::scan_batch> batch = fetch( first );
+       while( batch )
+       {
+          uint32_t next_first = first + batch->block_trx_count.size();
+          std::shared_ptr<detail::scan_batch> next_batch;
 
-                     case null_claim_type:
-                     default:
-                        FC_ASSERT( !"Invalid Claim Type" );
-                        break;
-                  }
-              }
+          // stage 1 & 2: match outputs against the wallet addresses while reading ahead
+          uint32_t trx_count = batch->trxs.size();
+          if( parallel && trx_count > 0 )
+          {
+             auto& threads = detail::scan_threads();
+             uint32_t slice_size = (trx_count + threads.size() - 1) / threads.size();
+             std::vector<fc::future<void>> slices;
+             for( uint32_t begin = 0; begin < trx_count; begin += slice_size )
+             {
+                uint32_t end = std::min( begin + slice_size, trx_count );
+                // the slices own the batch and address set in case this task is canceled while waiting
+                slices.push_back( threads[slices.size()]->async( [=]() { detail::match_outputs( *addrs, *batch, begin, end ); } ) );
+             }
+             if( next_first <= head_block_num )
+             {
+                next_batch = fetch( next_first );
+             }
+             for( auto& slice : slices )
+             {
+                slice.wait();
+             }
+          }
+          else
+          {
+             detail::match_outputs( *addrs, *batch, 0, trx_count );
+             if( next_first <= head_block_num )
+             {
+                next_batch = fetch( next_first );
+             }
+          }
+
+          // stage 3: apply in chain order
+          uint32_t trx_pos = 0;
+          for( uint32_t blk = 0; blk < batch->block_trx_count.size(); ++blk )
+          {
+             uint32_t block_num = first + blk;
+             uint32_t block_trx_count = batch->block_trx_count[blk];
+             for( uint32_t trx_idx = 0; trx_idx < block_trx_count; ++trx_idx, ++trx_pos )
+             {
+                if( cb ) cb( block_num, head_block_num, trx_idx, block_trx_count );
+
+                const meta_trx& trx = batch->trxs[trx_pos];
+                for( uint32_t in_idx = 0; in_idx < trx.inputs.size(); ++in_idx )
+                {
+                    mark_as_spent( trx.inputs[in_idx].output_ref );
+                }
+
+                const auto& matched = batch->matched_outputs[trx_pos];
+                for( auto out_itr = matched.begin(); out_itr != matched.end(); ++out_itr )
+                {
+                    my->apply_output( trx, batch->trx_ids[trx_pos], output_index( block_num, trx_idx, *out_itr ) );
+                    found = true;
+                }
+             }
           }
+          first = next_first;
+          batch = next_batch;
        }
        return found;
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
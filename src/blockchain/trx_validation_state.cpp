@@ -10,8 +10,8 @@
 namespace bts  { namespace blockchain { 
 
 trx_validation_state::trx_validation_state( const signed_transaction& t, blockchain_db* d, bool enf, uint32_t h )
-:allow_short_long_matching(false),
- prev_block_id1(0),prev_block_id2(0),trx(t),total_cdd(0),uncounted_cdd(0),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h)
+:allow_short_long_matching(false),skip_signatures(false),
+ prev_block_id1(0),prev_block_id2(0),trx(t),total_cdd(0),uncounted_cdd(0),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h),_signed_addresses_loaded(false)
 { 
   inputs  = d->fetch_inputs( t.inputs, ref_head );
   if( ref_head == std::numeric_limits<uint32_t>::max()  )
@@ -29,7 +29,21 @@ trx_validation_state::trx_validation_state( const signed_transaction& t, blockch
     balance_sheet[i].collat_out.unit  = (asset::bts);
     balance_sheet[i].neg_out.unit     = (asset::type)i;
   }
-  signed_addresses = t.get_signed_addresses();
+}
+
+void trx_validation_state::load_signed_addresses()
+{
+  if( !_signed_addresses_loaded )
+  {
+     // recover directly into the small set rather than through get_signed_addresses()
+     // which would allocate an unordered_set
+     auto dig = trx.digest();
+     for( auto itr = trx.sigs.begin(); itr != trx.sigs.end(); ++itr )
+     {
+        signed_addresses.insert( address( fc::ecc::public_key( *itr, dig ) ) );
+     }
+     _signed_addresses_loaded = true;
+  }
 }
 
 void trx_validation_state::validate()
@@ -75,10 +89,12 @@ void trx_validation_state::validate()
         }
      }
 
-     if( !signed_addresses.size() )
+     if( skip_signatures )
      {
-        signed_addresses =  trx.get_signed_addresses();
+        return;
      }
+
+     load_signed_addresses();
      std::vector<address> missing;
      for( auto itr  = required_sigs.begin(); itr != required_sigs.end(); ++itr )
      {
@@ -98,7 +114,7 @@ void trx_validation_state::validate()
      // count the total sigs required and then compare to actual number of sigs provided to
      // serve as the upper limit
 
-  } FC_RETHROW_EXCEPTIONS( warn, "error validating transaction", ("state", *this)  );
+  } FC_RETHROW_EXCEPTIONS( warn, "error validating transaction", ("trx", trx)("state", *this) );
 
 } // validate 
 
@@ -181,7 +197,6 @@ void trx_validation_state::validate_output( const trx_output& out )
 void trx_validation_state::validate_pts( const trx_output& o )
 {
    auto cbs = o.as<claim_by_pts_output>();
-   ilog( "${cbs}", ("cbs",cbs));
    FC_ASSERT( cbs.owner != pts_address() );
 
    balance_sheet[(asset::type)o.amount.unit].out += o.amount;
@@ -190,7 +205,6 @@ void trx_validation_state::validate_pts( const trx_output& o )
 void trx_validation_state::validate_signature( const trx_output& o )
 {
    auto cbs = o.as<claim_by_signature_output>();
-   ilog( "${cbs}", ("cbs",cbs));
    FC_ASSERT( cbs.owner != address() );
 
    balance_sheet[(asset::type)o.amount.unit].out += o.amount;
@@ -266,11 +280,12 @@ void trx_validation_state::validate_pts( const meta_trx_input& in )
 {
    try {
       auto pts_claim = in.output.as<claim_by_pts_output>();
-      auto pts_addrs = trx.get_signed_pts_addresses();
-      auto addrs = trx.get_signed_addresses();
-
-      FC_ASSERT( pts_addrs.find( pts_claim.owner ) != pts_addrs.end(),
-                "Unable to find signature by ${owner}", ("owner",pts_claim.owner)("signedby",pts_addrs)("addrs",addrs) );
+      if( !skip_signatures )
+      {
+         auto pts_addrs = trx.get_signed_pts_addresses();
+         FC_ASSERT( pts_addrs.find( pts_claim.owner ) != pts_addrs.end(),
+                   "Unable to find signature by ${owner}", ("owner",pts_claim.owner)("signedby",pts_addrs) );
+      }
 
       balance_sheet[(asset::type)in.output.amount.unit].in += in.output.amount;
 
@@ -307,7 +322,6 @@ void trx_validation_state::validate_signature( const meta_trx_input& in )
 {
    try {
        auto cbs = in.output.as<claim_by_signature_output>();
-       ilog( "${cbs}", ("cbs",cbs));
        required_sigs.insert( cbs.owner );
 
        balance_sheet[(asset::type)in.output.amount.unit].in += in.output.amount; //output_bal;
@@ -342,8 +356,7 @@ void trx_validation_state::validate_bid( const meta_trx_input& in )
     auto cbb = in.output.as<claim_by_bid_output>();
    
     balance_sheet[(asset::type)in.output.amount.unit].in += in.output.amount;
-
-    wlog( "      *** SIGNED BY ***     \n ${signed} \n ", ("signed", signed_addresses) );
+    load_signed_addresses();
 
     // if the pay address has signed the trx, then that means this is a cancel request
     if( signed_addresses.find( cbb.pay_address ) != signed_addresses.end() )
@@ -354,8 +367,6 @@ void trx_validation_state::validate_bid( const meta_trx_input& in )
     }
     else // someone else accepted the offer based upon the terms of the bid.
     {
-        wlog( "      *** SIGNED BY ***     \n ${signed} \n ", ("signed", signed_addresses) );
-
        // some orders may be split and thus result in
        // two outputs being generated... look for the split order first, then look
        // for the change!  Easy peesy..
@@ -404,6 +415,7 @@ void trx_validation_state::validate_long( const meta_trx_input& in )
     auto long_claim = in.output.as<claim_by_long_output>();
     const asset& output_bal = in.output.amount; //( in.output.amount, in.output.unit );
     balance_sheet[(asset::type)in.output.amount.unit].in += output_bal;
+    load_signed_addresses();
     
     if( signed_addresses.find( long_claim.pay_address ) != signed_addresses.end() )
     {
@@ -0,0 +1,90 @@
+#include <bts/bloom_filter.hpp>
+#include <fc/crypto/city.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace bts 
+{
+  bloom_filter::bloom_filter( uint64_t expected_items, double false_positive_rate )
+  :_expected_items( std::max<uint64_t>( expected_items, 1 ) ),_item_count(0)
+  {
+     FC_ASSERT( false_positive_rate > 0 && false_positive_rate < 1 );
+     const double ln2 = std::log(2.0);
+
+     // optimal bit and hash counts for the requested false positive rate
+     _bit_count  = uint64_t( std::ceil( -double(_expected_items) * std::log(false_positive_rate) / (ln2*ln2) ) );
+     _bit_count  = std::max<uint64_t>( _bit_count, 64 );
+     _hash_count = uint32_t( std::max( 1.0, std::round( double(_bit_count) / _expected_items * ln2 ) ) );
+     _bits.resize( (_bit_count + 63) / 64 );
+  }
+
+  /**
+   *  The k bit positions are derived from a single 128 bit hash using
+   *  double hashing:  h1 + i*h2
+   */
+  void bloom_filter::insert( const char* data, size_t len )
+  {
+     auto h  = fc::city_hash128( data, len );
+     uint64_t h1 = h.low_bits();
+     uint64_t h2 = h.high_bits() | 1;
+     for( uint32_t i = 0; i < _hash_count; ++i )
+     {
+        uint64_t bit = (h1 + i*h2) % _bit_count;
+        _bits[bit/64] |= uint64_t(1) << (bit%64);
+     }
+     ++_item_count;
+  }
+
+  bool bloom_filter::contains( const char* data, size_t len )const
+  {
+     auto h  = fc::city_hash128( data, len );
+     uint64_t h1 = h.low_bits();
+     uint64_t h2 = h.high_bits() | 1;
+     for( uint32_t i = 0; i < _hash_count; ++i )
+     {
+        uint64_t bit = (h1 + i*h2) % _bit_count;
+        if( !(_bits[bit/64] & (uint64_t(1) << (bit%64))) )
+        {
+           return false;
+        }
+     }
+     return true;
+  }
+
+  void bloom_filter::clear()
+  {
+     std::fill( _bits.begin(), _bits.end(), 0 );
+     _item_count = 0;
+  }
+
+  rolling_bloom_filter::rolling_bloom_filter( uint64_t items_per_generation, double false_positive_rate, 
+                                              const fc::microseconds& max_age )
+  :_max_age(max_age),
+   _generation_start( fc::time_point::now() ),
+   // an item may match either filter, so each gets half of the false positive budget
+   _current( items_per_generation, false_positive_rate / 2 ),
+   _previous( items_per_generation, false_positive_rate / 2 )
+  {
+  }
+
+  void rolling_bloom_filter::rotate_if_needed()
+  {
+     auto now = fc::time_point::now();
+     if( _current.size() >= _current.capacity() || now - _generation_start > _max_age )
+     {
+        std::swap( _current, _previous );
+        _current.clear();
+        _generation_start = now;
+     }
+  }
+
+  void rolling_bloom_filter::clear()
+  {
+     _current.clear();
+     _previous.clear();
+     _generation_start = fc::time_point::now();
+  }
+
+} // namespace bts
@@ -1,16 +1,104 @@
 #include <bts/keychain.hpp>
 #include <bts/proof_of_work.hpp>
+#include <bts/config.hpp>
 #include <fc/crypto/sha512.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/thread/thread.hpp>
+#include <fc/time.hpp>
 
 #include <fc/log/logger.hpp>
 
+#include <map>
+#include <thread>
+#include <tuple>
+
 namespace bts {
 
-  keychain::keychain(){}
+  namespace detail
+  {
+     /**
+      *  Caches the intermediate (non-leaf) keys of the derivation chain, 
+      *  identity -> account -> trx.  Each map is bounded by KEYCHAIN_CACHE_MAX_KEYS 
+      *  and private keys expire KEYCHAIN_PRIVATE_KEY_CACHE_SEC after the first one was
+      *  cached.  Expiry is lazy: expire_private_keys() runs at the start of the next 
+      *  private key lookup, so an idle keychain holds them until it is used again or 
+      *  destroyed.
+      */
+     class keychain_cache
+     {
+        public:
+          template<typename Map>
+          static void insert( Map& m, const typename Map::key_type& k, const typename Map::mapped_type& v )
+          {
+             if( m.size() >= KEYCHAIN_CACHE_MAX_KEYS ) m.clear();
+             m[k] = v;
+          }
+
+          template<typename Map>
+          void insert_private( Map& m, const typename Map::key_type& k, const typename Map::mapped_type& v )
+          {
+             if( _identity_keys.empty() && _private_accounts.empty() && _private_trxs.empty() )
+             {
+                _private_expiration = fc::time_point::now() + fc::seconds( KEYCHAIN_PRIVATE_KEY_CACHE_SEC );
+             }
+             insert( m, k, v );
+          }
+
+          void expire_private_keys()
+          {
+             if( fc::time_point::now() < _private_expiration ) return;
+             _identity_keys.clear();
+             _private_accounts.clear();
+             _private_trxs.clear();
+          }
+
+          std::map<std::string,extended_private_key>                                     _identity_keys;
+          std::map<std::tuple<std::string,uint32_t>,extended_private_key>                _private_accounts;
+          std::map<std::tuple<std::string,uint32_t>,extended_public_key>                 _public_accounts;
+          std::map<std::tuple<std::string,uint32_t,uint32_t>,extended_private_key>       _private_trxs;
+          std::map<std::tuple<std::string,uint32_t,uint32_t>,extended_public_key>        _public_trxs;
+          fc::time_point                                                                 _private_expiration;
+     };
+
+     /** address ranges smaller than this are not worth handing to other threads */
+     const uint32_t min_parallel_address_count = 256;
+
+     std::vector<std::unique_ptr<fc::thread> >& derivation_threads()
+     {
+        // function local statics are initialized exactly once even when called from several threads
+        static std::vector<std::unique_ptr<fc::thread> > threads = []()
+        {
+           std::vector<std::unique_ptr<fc::thread> > result;
+           uint32_t num_threads = std::max<uint32_t>( std::thread::hardware_concurrency(), 1 );
+           for( uint32_t i = 0; i < num_threads; ++i )
+           {
+              result.emplace_back( new fc::thread( "keychain" ) );
+           }
+           return result;
+        }();
+        return threads;
+     }
+  }
+
+  keychain::keychain()
+  :_cache( new detail::keychain_cache() ){}
+
+  keychain::keychain( const keychain& k )
+  :ext_priv_key( k.ext_priv_key ), _cache( new detail::keychain_cache() ){}
+
+  keychain::~keychain(){}
+
+  keychain& keychain::operator=( const keychain& k )
+  {
+     if( this != &k )
+     {
+        ext_priv_key = k.ext_priv_key;
+        _cache.reset( new detail::keychain_cache() );
+     }
+     return *this;
+  }
 
   /**
    *  This method will take several minutes to run and is designed to
@@ -20,18 +108,24 @@ namespace bts {
   {
       fc::thread t("stretch_seed");
 	  fc::sha512 stretched_seed = t.async( [=]() {
+          const uint32_t seed_count = 1024*1024*4;
+
+          // the result is the hash of the entire seed chain, but each link only
+          // depends upon the previous one so the chain can be streamed into the
+          // encoder rather than being held in memory all at once.
+          fc::sha512::encoder enc;
           fc::sha512 last = seed;
-          std::vector<fc::sha512> seeds(1024*1024*4);
-          seeds[0] = seed;
-          for( uint32_t i = 1; i < seeds.size(); ++i )
+          enc.write( (char*)&last, sizeof(last) );
+          for( uint32_t i = 1; i < seed_count; ++i )
           {
-             seeds[i] = fc::sha512::hash((char*)&seeds[i-1], sizeof(fc::sha512) ); 
+             last = fc::sha512::hash( (char*)&last, sizeof(last) ); 
+             enc.write( (char*)&last, sizeof(last) );
              if( ((i%(1024*40))==0) && progress )
              {
-                progress( double(i)/seeds.size() );
+                progress( double(i)/seed_count );
              }
           }
-          auto result = fc::sha512::hash( (char*)&seeds[0], sizeof(fc::sha512)*seeds.size() );
+          auto result = enc.result();
           if( progress )
 			progress( double(1.0) );
           return result;
@@ -43,35 +137,68 @@ namespace bts {
   void              keychain::set_seed( const fc::sha512& stretched_seed )
   {
     ext_priv_key = extended_private_key(stretched_seed);
+    _cache.reset( new detail::keychain_cache() );
   }
 
   fc::sha512        keychain::get_seed()const
   {
-    static_assert( sizeof(*this) == sizeof( fc::sha512), "make sure there is no funny packing going on" );
+    static_assert( sizeof(ext_priv_key) == sizeof( fc::sha512), "make sure there is no funny packing going on" );
     fc::sha512 seed;
-    memcpy( (char*)&seed, (char*)this, sizeof(seed) );
+    memcpy( (char*)&seed, (char*)&ext_priv_key, sizeof(seed) );
     return seed;
   }
   extended_private_key  keychain::get_identity_key( const std::string& ident )
   {
-    return ext_priv_key.child( fc::hash64(ident.c_str(),ident.size()),false );
+    _cache->expire_private_keys();
+    auto itr = _cache->_identity_keys.find( ident );
+    if( itr != _cache->_identity_keys.end() )
+    {
+       return itr->second;
+    }
+    auto r = ext_priv_key.child( fc::hash64(ident.c_str(),ident.size()),false );
+    _cache->insert_private( _cache->_identity_keys, ident, r );
+    return r;
   }
 
   extended_private_key  keychain::get_private_account( const std::string& ident, uint32_t i )
   {
-    return get_identity_key(ident).child( i, false );
+    _cache->expire_private_keys();
+    auto key = std::make_tuple( ident, i );
+    auto itr = _cache->_private_accounts.find( key );
+    if( itr != _cache->_private_accounts.end() )
+    {
+       return itr->second;
+    }
+    auto r = get_identity_key(ident).child( i, false );
+    _cache->insert_private( _cache->_private_accounts, key, r );
+    return r;
   }
 
   extended_public_key   keychain::get_public_account( const std::string& ident, uint32_t i )
   {
+    auto key = std::make_tuple( ident, i );
+    auto itr = _cache->_public_accounts.find( key );
+    if( itr != _cache->_public_accounts.end() )
+    {
+       return itr->second;
+    }
     auto priv_acnt = get_private_account(ident,i);
-    return extended_public_key( priv_acnt.get_public_key(), priv_acnt.chain_code );
+    auto r = extended_public_key( priv_acnt.get_public_key(), priv_acnt.chain_code );
+    _cache->insert( _cache->_public_accounts, key, r );
+    return r;
   }
 
   extended_public_key   keychain::get_public_trx( const std::string& ident, uint32_t account, uint32_t trx )
   {
+    auto key = std::make_tuple( ident, account, trx );
+    auto itr = _cache->_public_trxs.find( key );
+    if( itr != _cache->_public_trxs.end() )
+    {
+       return itr->second;
+    }
     auto r = get_public_account( ident, account ).child( trx );
 //    ilog( "ext pub trx: ${account}/${trx} => ${epk}", ("account",account)("trx",trx)("epk",r) );
+    _cache->insert( _cache->_public_trxs, key, r );
     return r;
   }
 
@@ -82,8 +209,16 @@ namespace bts {
 
   extended_private_key  keychain::get_private_trx( const std::string& ident, uint32_t account, uint32_t trx )
   {
+    _cache->expire_private_keys();
+    auto key = std::make_tuple( ident, account, trx );
+    auto itr = _cache->_private_trxs.find( key );
+    if( itr != _cache->_private_trxs.end() )
+    {
+       return itr->second;
+    }
     auto r =  get_private_account( ident, account ).child( trx, true/*pub deriv*/ );
  //   ilog( "ext priv trx: ${account}/${trx} => ${epk}", ("account",account)("trx",trx)("epk",r) );
+    _cache->insert_private( _cache->_private_trxs, key, r );
     return r;
   }
 
@@ -92,5 +227,56 @@ namespace bts {
     return get_private_trx( ident, account, trx ).child(addr, true /*pub deriv*/);
   }
 
+  std::vector<fc::ecc::public_key> keychain::get_public_trx_addresses( const std::string& ident, uint32_t account, uint32_t trx,
+                                                                       uint32_t first_addr, uint32_t count )
+  { try {
+    const extended_public_key trx_key = get_public_trx( ident, account, trx );
+
+    std::vector<fc::ecc::public_key> addresses(count);
+    if( count < detail::min_parallel_address_count )
+    {
+       for( uint32_t i = 0; i < count; ++i )
+       {
+          addresses[i] = trx_key.child( first_addr + i );
+       }
+       return addresses;
+    }
+
+    // each thread fills in its own disjoint slice of addresses
+    auto& threads = detail::derivation_threads();
+    uint32_t slice_size = (count + threads.size() - 1) / threads.size();
+    std::vector<fc::future<void>> slices;
+    for( uint32_t start = 0; start < count; start += slice_size )
+    {
+       uint32_t end = std::min( start + slice_size, count );
+       fc::ecc::public_key* out = addresses.data();
+       slices.push_back( threads[slices.size()]->async( [=]() {
+          for( uint32_t i = start; i < end; ++i )
+          {
+             out[i] = trx_key.child( first_addr + i );
+          }
+       } ) );
+    }
+    for( auto& slice : slices )
+    {
+       slice.wait();
+    }
+    return addresses;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("ident",ident)("account",account)("trx",trx)("first_addr",first_addr)("count",count) ) }
+
+  std::vector<fc::ecc::private_key> keychain::get_private_trx_addresses( const std::string& ident, uint32_t account, uint32_t trx,
+                                                                         uint32_t first_addr, uint32_t count )
+  {
+    const extended_private_key trx_key = get_private_trx( ident, account, trx );
+
+    std::vector<fc::ecc::private_key> addresses;
+    addresses.reserve(count);
+    for( uint32_t i = 0; i < count; ++i )
+    {
+       addresses.push_back( trx_key.child( first_addr + i, true /*pub deriv*/ ) );
+    }
+    return addresses;
+  }
+
   
 } // namespace bts
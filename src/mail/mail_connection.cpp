@@ -243,15 +243,15 @@ namespace mail {
   }
 
   void connection::send( const message& m )
+  {
+    send( pack_message( m ) );
+  }
+
+  void connection::send( const packed_message& m )
   {
     try {
       fc::scoped_lock<fc::mutex> lock(my->write_lock);
-      size_t len = MAIL_PACKED_MESSAGE_HEADER + m.size;
-      len = 16*((len+15)/16); //pad the message we send to a multiple of 16 bytes
-      std::vector<char> tmp(len);
-      memcpy( tmp.data(), (char*)&m, MAIL_PACKED_MESSAGE_HEADER );
-      memcpy( tmp.data() + MAIL_PACKED_MESSAGE_HEADER, m.data.data(), m.size );
-      my->sock->write( tmp.data(), tmp.size() );
+      my->sock->write( m->data(), m->size() );
       my->sock->flush();
     } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
   }
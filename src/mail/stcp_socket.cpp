@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <mail/stcp_socket.hpp>
+#include <bts/network/crypto_pool.hpp>
 #include <fc/crypto/hex.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/city.hpp>
@@ -21,14 +22,14 @@ stcp_socket::~stcp_socket()
 void     stcp_socket::connect_to( const fc::ip::endpoint& ep )
 {
     _sock.connect_to( ep );
-    _priv_key = fc::ecc::private_key::generate();
+    _priv_key = bts::network::crypto_pool::instance().take_ephemeral_key();
     fc::ecc::public_key pub = _priv_key.get_public_key();
     auto s = pub.serialize();
     _sock.write( (char*)&s, sizeof(s) );
     fc::ecc::public_key_data rpub;
     _sock.read( (char*)&rpub, sizeof(rpub) );
 
-    auto shared_secret = _priv_key.get_shared_secret( rpub );
+    auto shared_secret = bts::network::crypto_pool::instance().get_shared_secret( _priv_key, rpub );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
     _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
                     fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
@@ -101,14 +102,14 @@ void     stcp_socket::close()
 
 void    stcp_socket::accept()
 {
-    _priv_key = fc::ecc::private_key::generate();
+    _priv_key = bts::network::crypto_pool::instance().take_ephemeral_key();
     fc::ecc::public_key pub = _priv_key.get_public_key();
     auto s = pub.serialize();
     _sock.write( (char*)&s, sizeof(s) );
     fc::ecc::public_key_data rpub;
     _sock.read( (char*)&rpub, sizeof(rpub) );
 
-    auto shared_secret = _priv_key.get_shared_secret( fc::ecc::public_key(rpub) );
+    auto shared_secret = bts::network::crypto_pool::instance().get_shared_secret( _priv_key, fc::ecc::public_key(rpub) );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
     _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
                     fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
@@ -1,5 +1,6 @@
 #include <bts/network/connection.hpp>
 #include <bts/network/message.hpp>
+#include <bts/network/message_buffer_pool.hpp>
 #include <bts/config.hpp>
 
 #include <fc/network/tcp_socket.hpp>
@@ -9,9 +10,8 @@
 #include <fc/io/raw.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/string.hpp>
-#include <fc/thread/mutex.hpp>
-#include <fc/thread/scoped_lock.hpp>
 
+#include <deque>
 #include <unordered_map>
 
 namespace bts { namespace network {
@@ -22,24 +22,93 @@ namespace bts { namespace network {
      {
         public:
           connection_impl(connection& s)
-          :self(s),con_del(nullptr){}
+          :self(s),con_del(nullptr),send_queue_bytes(0),recv_bytes(0){}
           connection&          self;
           stcp_socket_ptr      sock;
           fc::ip::endpoint     remote_ep;
           connection_delegate* con_del;
 
           std::unordered_map<uint64_t,channel_data_ptr> chan_data;
-
-          /** used to ensure that messages are written completely */
-          fc::mutex              write_lock;
+          std::unordered_map<uint32_t,compression_type> compression_by_chan;
 
           fc::future<void>       read_loop_complete;
+          uint64_t               recv_bytes;
+
+          /** 
+           *  Packed and padded messages waiting to be written, they are only written by 
+           *  write_loop() so send() never blocks on a slow socket. 
+           */
+          std::deque<packed_message> send_queue;
+          uint64_t               send_queue_bytes;
+          std::vector<char>      write_buffer; // reused to coalesce small frames
+          fc::future<void>       write_loop_complete;
+
+          void queue_frame( const packed_message& frame )
+          {
+            if( send_queue_bytes + frame->size() > NETWORK_SEND_QUEUE_MAX )
+            {
+               wlog( "closing connection to ${ep}, ${bytes} bytes are waiting to be sent", 
+                     ("ep",remote_ep)("bytes",send_queue_bytes) );
+               send_queue.clear();
+               send_queue_bytes = 0;
+               sock->get_socket().close(); // read_loop() will report the disconnect
+               return;
+            }
+            send_queue.push_back( frame );
+            send_queue_bytes += frame->size();
+            if( !write_loop_complete.valid() || write_loop_complete.ready() )
+            {
+               write_loop_complete = fc::async( [this](){ write_loop(); } );
+            }
+          }
+
+          /**
+           *  Drains the send queue, combining consecutive small frames into writes of
+           *  up to NETWORK_MAX_COALESCED_WRITE bytes.  Exits once the queue is empty and
+           *  is restarted by the next send.
+           */
+          void write_loop()
+          {
+            try {
+               while( send_queue.size() )
+               {
+                  packed_message front = send_queue.front();
+                  if( send_queue.size() == 1 || front->size() >= NETWORK_MAX_COALESCED_WRITE )
+                  {
+                     send_queue.pop_front();
+                     send_queue_bytes -= front->size();
+                     sock->write( front->data(), front->size() );
+                     continue;
+                  }
+
+                  write_buffer.clear();
+                  while( send_queue.size() && 
+                         write_buffer.size() + send_queue.front()->size() <= NETWORK_MAX_COALESCED_WRITE )
+                  {
+                     const std::vector<char>& frame = *send_queue.front();
+                     write_buffer.insert( write_buffer.end(), frame.begin(), frame.end() );
+                     send_queue_bytes -= frame.size();
+                     send_queue.pop_front();
+                  }
+                  sock->write( write_buffer.data(), write_buffer.size() );
+               }
+               sock->flush();
+            } 
+            catch ( const fc::exception& e )
+            {
+               // the read loop will notice the disconnect as well
+               wlog( "error writing to ${ep}\n${e}", ("ep",remote_ep)("e",e.to_detail_string()) );
+               send_queue.clear();
+               send_queue_bytes = 0;
+            }
+          }
 
           void read_loop()
           {
             const int BUFFER_SIZE = 16;
             const int LEFTOVER = BUFFER_SIZE - PACKED_MESSAGE_HEADER;
             try {
+               message_buffer_pool& pool = message_buffer_pool::instance();
                message m;
                while( true )
                {
@@ -58,12 +127,21 @@ namespace bts { namespace network {
                      tmpPtr += sizeof(m.chan_num);
                      memcpy( (char*)(&(m.msg_type)), tmpPtr, 2);
                   #endif
-                  m.data.resize( m.size + 16 ); //give extra 16 bytes to allow for padding added in send call
+                  m.data = pool.acquire( m.size + 16 ); //give extra 16 bytes to allow for padding added in send call
                   memcpy( (char*)m.data.data(), tmp + PACKED_MESSAGE_HEADER, LEFTOVER );
                   sock->read( m.data.data() + LEFTOVER, 16*((m.size -LEFTOVER + 15)/16) );
+                  recv_bytes += BUFFER_SIZE + 16*((m.size -LEFTOVER + 15)/16);
                   m.data.resize(m.size);
 
                   try { // message handling errors are warnings... 
+                    if( m.msg_type & MESSAGE_COMPRESSED_FLAG )
+                    {
+                       auto raw = decompress_data( m );
+                       pool.release( std::move(m.data) );
+                       m.data      = std::move(raw);
+                       m.size      = m.data.size();
+                       m.msg_type &= ~MESSAGE_COMPRESSED_FLAG;
+                    }
                     con_del->on_connection_message( self, m );
                   } 
                   catch ( fc::canceled_exception& ) { throw; }
@@ -73,6 +151,8 @@ namespace bts { namespace network {
                      wlog( "disconnected ${er}", ("er", e.to_detail_string() ) );
                      // TODO: log and potentiall disconnect... for now just warn.
                   }
+                  // delegates only see m during the call, so its storage can be reused
+                  pool.release( std::move(m.data) );
                }
             } 
             catch ( const fc::canceled_exception& )
@@ -174,6 +254,10 @@ namespace bts { namespace network {
          if( my->sock )
          {
            my->sock->get_socket().close();
+           if( my->write_loop_complete.valid() )
+           {
+              my->write_loop_complete.wait(); // exits once the socket is closed
+           }
            if( my->read_loop_complete.valid() )
            {
               wlog( "waiting for socket to close" );
@@ -218,29 +302,61 @@ namespace bts { namespace network {
   void connection::send( const message& m )
   {
     try {
-      fc::scoped_lock<fc::mutex> lock(my->write_lock);
-      size_t len = PACKED_MESSAGE_HEADER + m.size;
-      len = 16*((len+15)/16); //pad the message we send to a multiple of 16 bytes
-      std::vector<char> tmp(len);
-      #ifndef WIN32
-        memcpy( tmp.data(), (char*)&m, PACKED_MESSAGE_HEADER );
-      #else
-         // TODO: clean this up
-         char* tmpPtr = tmp.data();
-         memcpy( tmpPtr, (char*)(&m), MESSAGE_HEADER_SIZE_FIELD_SIZE );
-         tmpPtr += MESSAGE_HEADER_SIZE_FIELD_SIZE;
-         memcpy( tmpPtr, (char*)&(m.proto), sizeof(m.proto) );
-         tmpPtr += sizeof(m.proto);
-         memcpy( tmpPtr, (char*)&(m.chan_num), sizeof(m.chan_num) );
-         tmpPtr += sizeof(m.chan_num);
-         memcpy( tmpPtr, (char*)&(m.msg_type), sizeof(m.msg_type) );
-      #endif
-      memcpy( tmp.data() + PACKED_MESSAGE_HEADER, m.data.data(), m.size );
-      my->sock->write( tmp.data(), tmp.size() );
-      my->sock->flush();
+      auto mode = get_compression( m.channel() );
+      if( mode != no_compression && m.size >= NETWORK_COMPRESSION_THRESHOLD )
+      {
+         auto compressed = compress_message( m, mode );
+         if( compressed )
+         {
+            my->queue_frame( pack_message( *compressed ) );
+            return;
+         }
+      }
+      my->queue_frame( pack_message( m ) );
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
+  }
+
+  void connection::set_compression( const channel_id& chan, compression_type t )
+  {
+     if( t == no_compression )
+     {
+        my->compression_by_chan.erase( chan.id() );
+     }
+     else
+     {
+        my->compression_by_chan[chan.id()] = t;
+     }
+  }
+
+  compression_type connection::get_compression( const channel_id& chan )const
+  {
+     auto itr = my->compression_by_chan.find( chan.id() );
+     return itr != my->compression_by_chan.end() ? itr->second : no_compression;
+  }
+
+  void connection::send( const packed_message& m )
+  {
+    try {
+      FC_ASSERT( m && m->size() >= PACKED_MESSAGE_HEADER && m->size() % 16 == 0 );
+      my->queue_frame( m );
     } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
   }
 
+  uint64_t connection::bytes_received()const
+  {
+     return my->recv_bytes;
+  }
+
+  uint64_t connection::queued_send_bytes()const
+  {
+     return my->send_queue_bytes;
+  }
+
+  bool connection::is_congested()const
+  {
+     return my->send_queue_bytes > NETWORK_SEND_QUEUE_HIGH_WATER;
+  }
+
   void connection::set_channel_data( const channel_id& cid, const channel_data_ptr& d )
   {
      my->chan_data[cid.id()] = d;
@@ -0,0 +1,101 @@
+#include <bts/network/crypto_pool.hpp>
+#include <bts/config.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/optional.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace network {
+
+  crypto_pool::crypto_pool( uint32_t num_threads )
+  :_next_thread(0)
+  {
+     FC_ASSERT( num_threads > 0 );
+     for( uint32_t i = 0; i < num_threads; ++i )
+     {
+        _threads.emplace_back( new fc::thread( "crypto" ) );
+     }
+     refill_keys();
+  }
+
+  crypto_pool::~crypto_pool()
+  {
+     try {
+        std::unique_lock<std::mutex> lock(_key_lock);
+        auto refill = _refill_complete;
+        lock.unlock();
+        if( refill.valid() ) 
+        {
+           refill.wait();
+        }
+     } 
+     catch ( const fc::exception& e )
+     {
+        wlog( "${e}", ("e",e.to_detail_string()) );
+     }
+  }
+
+  crypto_pool& crypto_pool::instance()
+  {
+     static crypto_pool pool( NETWORK_CRYPTO_THREADS );
+     return pool;
+  }
+
+  fc::thread& crypto_pool::next_thread()
+  {
+     return *_threads[ _next_thread++ % _threads.size() ];
+  }
+
+  /**
+   *  Tops the key pool up to NETWORK_EPHEMERAL_KEY_POOL_SIZE on a worker once it 
+   *  falls below half, at most one refill runs at a time.
+   */
+  void crypto_pool::refill_keys()
+  {
+     std::lock_guard<std::mutex> lock(_key_lock);
+     if( _keys.size() >= NETWORK_EPHEMERAL_KEY_POOL_SIZE / 2 ) return;
+     if( _refill_complete.valid() && !_refill_complete.ready() ) return;
+
+     _refill_complete = next_thread().async( [this]()
+     {
+        std::vector<fc::ecc::private_key> keys;
+        {
+           std::lock_guard<std::mutex> lock(_key_lock);
+           keys.resize( NETWORK_EPHEMERAL_KEY_POOL_SIZE - std::min<size_t>( _keys.size(), NETWORK_EPHEMERAL_KEY_POOL_SIZE ) );
+        }
+        for( auto itr = keys.begin(); itr != keys.end(); ++itr )
+        {
+           *itr = fc::ecc::private_key::generate();
+        }
+        std::lock_guard<std::mutex> lock(_key_lock);
+        _keys.insert( _keys.end(), keys.begin(), keys.end() );
+     } );
+  }
+
+  fc::ecc::private_key crypto_pool::take_ephemeral_key()
+  {
+     fc::optional<fc::ecc::private_key> key;
+     {
+        std::lock_guard<std::mutex> lock(_key_lock);
+        if( _keys.size() )
+        {
+           key = _keys.front();
+           _keys.pop_front();
+        }
+     }
+     refill_keys();
+     if( key ) return *key;
+
+     // the pool ran dry during a connection storm
+     return next_thread().async( [](){ return fc::ecc::private_key::generate(); } ).wait();
+  }
+
+  fc::sha512 crypto_pool::get_shared_secret( const fc::ecc::private_key& k, const fc::ecc::public_key& remote )
+  {
+     // captured by value, the caller's arguments may be gone if it is canceled while waiting
+     return next_thread().async( [k,remote](){ return k.get_shared_secret( remote ); } ).wait();
+  }
+
+} } // bts::network
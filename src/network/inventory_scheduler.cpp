@@ -0,0 +1,100 @@
+#include <bts/network/inventory_scheduler.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+namespace bts { namespace network {
+
+  inventory_scheduler::inventory_scheduler()
+  :_stopping(false),_wake_time(fc::time_point::maximum()),_wake( new fc::promise<void>() )
+  {
+  }
+
+  inventory_scheduler::~inventory_scheduler()
+  {
+     try {
+        stop();
+     } 
+     catch ( const fc::exception& e )
+     {
+        wlog( "unhandled exception stopping inventory scheduler\n${e}", ("e",e.to_detail_string()) );
+     }
+  }
+
+  void inventory_scheduler::start( const std::function<void()>& work )
+  {
+     FC_ASSERT( !_run_complete.valid() || _run_complete.ready(), "scheduler already started" );
+     _work         = work;
+     _stopping     = false;
+     _run_complete = fc::async( [this](){ run(); } );
+  }
+
+  void inventory_scheduler::stop()
+  {
+     if( _run_complete.valid() && !_run_complete.ready() )
+     {
+        _stopping = true;
+        notify();
+        _run_complete.wait();
+     }
+     _work = std::function<void()>(); // release anything the work captured
+  }
+
+  void inventory_scheduler::notify()
+  {
+     notify_at( fc::time_point::now() );
+  }
+
+  void inventory_scheduler::notify_at( const fc::time_point& t )
+  {
+     if( t < _wake_time )
+     {
+        _wake_time = t;
+        if( !_wake->ready() ) 
+        {
+           _wake->set_value(); // let run() recalculate how long to sleep
+        }
+     }
+  }
+
+  void inventory_scheduler::run()
+  {
+     while( !_stopping )
+     {
+        auto now = fc::time_point::now();
+        if( _wake_time > now )
+        {
+           _wake.reset( new fc::promise<void>() );
+           try {
+              if( _wake_time == fc::time_point::maximum() )
+              {
+                 fc::future<void>( _wake ).wait(); // nothing scheduled, maximum() - now would overflow
+              }
+              else
+              {
+                 fc::future<void>( _wake ).wait( _wake_time - now );
+              }
+           } 
+           catch ( const fc::timeout_exception& )
+           {
+           }
+           continue;
+        }
+
+        _wake_time = fc::time_point::maximum();
+        try {
+           _work();
+        } 
+        catch ( const fc::canceled_exception& )
+        {
+           throw;
+        }
+        catch ( const fc::exception& e )
+        {
+           wlog( "${e}", ("e", e.to_detail_string()) );
+        }
+        fc::yield(); // let other tasks run between passes when the work notifies itself
+     }
+  }
+
+} } // bts::network
@@ -0,0 +1,85 @@
+#include <bts/network/message.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <zlib.h>
+#include <algorithm>
+#include <string.h>
+
+namespace bts { namespace network {
+
+  namespace detail
+  {
+     /** the largest message data that may be decompressed, matches the 24 bit size field */
+     const size_t max_decompressed_size = (1<<24);
+
+     /** releases the inflate state on every exit path */
+     struct inflate_stream : public z_stream
+     {
+        inflate_stream()
+        {
+           memset( static_cast<z_stream*>(this), 0, sizeof(z_stream) );
+           FC_ASSERT( inflateInit( this ) == Z_OK );
+        }
+        ~inflate_stream() { inflateEnd( this ); }
+     };
+  }
+
+  fc::optional<message> compress_message( const message& m, compression_type t )
+  { try {
+     FC_ASSERT( t == zlib_compression );
+     FC_ASSERT( !(m.msg_type & MESSAGE_COMPRESSED_FLAG) );
+
+     message result;
+     result.proto    = m.proto;
+     result.chan_num = m.chan_num;
+     result.msg_type = m.msg_type | MESSAGE_COMPRESSED_FLAG;
+
+     // the fastest level, this runs on the network thread for every connection
+     uLongf len = compressBound( m.data.size() );
+     result.data.resize( len );
+     int rc = compress2( (Bytef*)result.data.data(), &len, (const Bytef*)m.data.data(), m.data.size(), Z_BEST_SPEED );
+     FC_ASSERT( rc == Z_OK, "zlib error ${rc}", ("rc",rc) );
+     result.data.resize( len );
+
+     if( result.data.empty() || result.data.size() >= m.data.size() )
+     {
+        return fc::optional<message>(); // not worth the receiver's time to decompress
+     }
+     result.size = result.data.size();
+     return result;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("type",t)("size",m.size) ) }
+
+  std::vector<char> decompress_data( const message& m )
+  { try {
+     FC_ASSERT( m.msg_type & MESSAGE_COMPRESSED_FLAG );
+
+     // inflate into a buffer that grows up to the message limit and give up as soon as
+     // the output would exceed it, a small message must not be able to inflate unbounded
+     std::vector<char> data( std::min<size_t>( std::max<size_t>( m.data.size() * 4, 4096 ),
+                                               detail::max_decompressed_size ) );
+     detail::inflate_stream strm;
+     strm.next_in   = (Bytef*)m.data.data();
+     strm.avail_in  = m.data.size();
+     strm.next_out  = (Bytef*)data.data();
+     strm.avail_out = data.size();
+
+     int rc = Z_OK;
+     while( rc == Z_OK || (rc == Z_BUF_ERROR && strm.avail_out == 0) )
+     {
+        if( strm.avail_out == 0 )
+        {
+           size_t used = data.size();
+           FC_ASSERT( used < detail::max_decompressed_size, "decompressed message exceeds the 16 MB message limit" );
+           data.resize( std::min<size_t>( used * 2, detail::max_decompressed_size ) );
+           strm.next_out  = (Bytef*)data.data() + used;
+           strm.avail_out = data.size() - used;
+        }
+        rc = inflate( &strm, Z_NO_FLUSH );
+     }
+     FC_ASSERT( rc == Z_STREAM_END, "invalid compressed data, zlib error ${rc}", ("rc",rc) );
+     FC_ASSERT( strm.total_out < detail::max_decompressed_size, "decompressed message exceeds the 16 MB message limit" );
+     data.resize( strm.total_out );
+     return data;
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to decompress message", ("size",m.size) ) }
+
+} } // bts::network
@@ -0,0 +1,85 @@
+#include <bts/network/message_buffer_pool.hpp>
+#include <bts/config.hpp>
+
+namespace bts { namespace network {
+
+  message_buffer_pool::message_buffer_pool( uint64_t max_pooled_bytes )
+  :_max_pooled_bytes(max_pooled_bytes)
+  {
+  }
+
+  message_buffer_pool& message_buffer_pool::instance()
+  {
+     static message_buffer_pool pool( NETWORK_BUFFER_POOL_SIZE );
+     return pool;
+  }
+
+  std::vector<char> message_buffer_pool::acquire( size_t size )
+  {
+     uint32_t bits = min_class_bits;
+     while( bits <= max_class_bits && (size_t(1) << bits) < size ) 
+     {
+        ++bits;
+     }
+
+     std::vector<char> buf;
+     if( bits <= max_class_bits )
+     {
+        std::lock_guard<std::mutex> lock(_lock);
+        auto& free_list = _free[bits - min_class_bits];
+        if( free_list.size() )
+        {
+           buf = std::move( free_list.back() );
+           free_list.pop_back();
+           _stats.pooled_bytes -= buf.capacity();
+           ++_stats.hits;
+        }
+        else
+        {
+           ++_stats.misses;
+        }
+     }
+     else
+     {
+        std::lock_guard<std::mutex> lock(_lock);
+        ++_stats.misses;
+     }
+
+     if( buf.capacity() == 0 && bits <= max_class_bits )
+     {
+        buf.reserve( size_t(1) << bits );
+     }
+     buf.resize( size );
+     return buf;
+  }
+
+  void message_buffer_pool::release( std::vector<char> buf )
+  {
+     // file the buffer under the largest class it can fully serve
+     uint32_t bits = min_class_bits;
+     while( bits < max_class_bits && (size_t(1) << (bits+1)) <= buf.capacity() ) 
+     {
+        ++bits;
+     }
+
+     std::lock_guard<std::mutex> lock(_lock);
+     if( buf.capacity() < (size_t(1) << min_class_bits) || 
+         buf.capacity() > (size_t(2) << max_class_bits) || 
+         _stats.pooled_bytes + buf.capacity() > _max_pooled_bytes )
+     {
+        ++_stats.discarded;
+        return;
+     }
+     ++_stats.released;
+     _stats.pooled_bytes += buf.capacity();
+     buf.clear();
+     _free[bits - min_class_bits].push_back( std::move(buf) );
+  }
+
+  buffer_pool_stats message_buffer_pool::get_stats()const
+  {
+     std::lock_guard<std::mutex> lock(_lock);
+     return _stats;
+  }
+
+} } // bts::network
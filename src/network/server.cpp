@@ -225,10 +225,38 @@ namespace bts { namespace network {
   }
   void server::broadcast( const message& m )
   {
+      // serialize once and share the frame with every connection, connections
+      // that negotiated compression for this channel share a compressed frame
+      packed_message packed;
+      packed_message packed_compressed;
+      bool           compression_attempted = false;
       for( auto itr = my->connections.begin(); itr != my->connections.end(); ++itr )
       {
         try {
-           itr->second->send(m);
+           if( itr->second->is_congested() )
+           {
+              // the connection is falling behind, it can fetch whatever it misses from its peers
+              wlog( "not broadcasting to congested connection ${ep}, ${bytes} bytes queued", 
+                    ("ep",itr->first)("bytes",itr->second->queued_send_bytes()) );
+              continue;
+           }
+           auto mode = itr->second->get_compression( m.channel() );
+           if( mode != no_compression && m.size >= NETWORK_COMPRESSION_THRESHOLD )
+           {
+              if( !compression_attempted )
+              {
+                 compression_attempted = true;
+                 auto compressed = compress_message( m, mode );
+                 if( compressed ) packed_compressed = pack_message( *compressed );
+              }
+              if( packed_compressed )
+              {
+                 itr->second->send( packed_compressed );
+                 continue;
+              }
+           }
+           if( !packed ) packed = pack_message( m );
+           itr->second->send( packed );
         } 
         catch ( const fc::exception& e ) 
         {
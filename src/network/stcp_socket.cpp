@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <bts/network/stcp_socket.hpp>
+#include <bts/network/crypto_pool.hpp>
+#include <bts/config.hpp>
 #include <fc/crypto/hex.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/city.hpp>
@@ -21,14 +23,14 @@ stcp_socket::~stcp_socket()
 void     stcp_socket::connect_to( const fc::ip::endpoint& ep )
 {
     _sock.connect_to( ep );
-    _priv_key = fc::ecc::private_key::generate();
+    _priv_key = crypto_pool::instance().take_ephemeral_key();
     fc::ecc::public_key pub = _priv_key.get_public_key();
     auto s = pub.serialize();
     _sock.write( (char*)&s, sizeof(s) );
     fc::ecc::public_key_data rpub;
     _sock.read( (char*)&rpub, sizeof(rpub) );
 
-    auto shared_secret = _priv_key.get_shared_secret( rpub );
+    auto shared_secret = crypto_pool::instance().get_shared_secret( _priv_key, rpub );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
     _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
                     fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
@@ -37,25 +39,24 @@ void     stcp_socket::connect_to( const fc::ip::endpoint& ep )
 }
 
 /**
- *   This method must read at least 8 bytes at a time from
- *   the underlying TCP socket so that it can decrypt them. It
- *   will buffer any left-over.
+ *   This method must read at least 16 bytes at a time from
+ *   the underlying TCP socket so that it can decrypt them.  The
+ *   cipher text is read directly into buffer and decrypted in
+ *   place, so there is no limit on how much is read per call.
  */
 size_t   stcp_socket::readsome( char* buffer, size_t len )
 { try {
     assert( (len % 16) == 0 );
     assert( len >= 16 );
-    char crypt_buf[4096];
-    len = std::min<size_t>(sizeof(crypt_buf),len);
 
-    size_t s = _sock.readsome( crypt_buf, len );
+    size_t s = _sock.readsome( buffer, len );
     if( s % 16 ) 
     {
-        ilog( "s: %{s}", ("s",s) );
-        _sock.read( crypt_buf + s, 16 - (s%16) );
+        // len is a multiple of 16 so the rest of the block fits in buffer
+        _sock.read( buffer + s, 16 - (s%16) );
         s += 16-(s%16);
     }
-    _recv_aes.decode( crypt_buf, s, buffer );
+    _recv_aes.decode( buffer, s, buffer );
     return s;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
@@ -64,25 +65,22 @@ bool     stcp_socket::eof()const
   return _sock.eof();
 }
 
+/**
+ *  buffer may be shared with other connections (see pack_message) so it is 
+ *  encrypted into _crypt_buf, which grows to fit writes of up to 
+ *  NETWORK_MAX_CRYPT_CHUNK bytes instead of being limited to a small stack buffer.
+ */
 size_t   stcp_socket::writesome( const char* buffer, size_t len )
 { try {
     assert( len % 16 == 0 );
     assert( len > 0 );
-    char crypt_buf[4096];
-    len = std::min<size_t>(sizeof(crypt_buf),len);
-    memcpy( crypt_buf, buffer, len );
-    /**
-     * every sizeof(crypt_buf) bytes the blowfish channel
-     * has an error and doesn't decrypt properly...  disable
-     * for now because we are going to upgrade to something
-     * better.
-     */
-    //auto cipher_len =
-    _send_aes.encode( buffer, len, crypt_buf );
-    FC_ASSERT( len >= 16 );
-    FC_ASSERT( len % 16 == 0);
-   // memcpy( crypt_buf, buffer, len );
-    _sock.write( (char*)crypt_buf, len );
+    len = std::min<size_t>( NETWORK_MAX_CRYPT_CHUNK, len );
+    if( _crypt_buf.size() < len )
+    {
+       _crypt_buf.resize( len );
+    }
+    _send_aes.encode( buffer, len, _crypt_buf.data() );
+    _sock.write( _crypt_buf.data(), len );
     return len;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
@@ -102,14 +100,14 @@ void     stcp_socket::close()
 
 void    stcp_socket::accept()
 {
-    _priv_key = fc::ecc::private_key::generate();
+    _priv_key = crypto_pool::instance().take_ephemeral_key();
     fc::ecc::public_key pub = _priv_key.get_public_key();
     auto s = pub.serialize();
     _sock.write( (char*)&s, sizeof(s) );
     fc::ecc::public_key_data rpub;
     _sock.read( (char*)&rpub, sizeof(rpub) );
 
-    auto shared_secret = _priv_key.get_shared_secret( fc::ecc::public_key(rpub) );
+    auto shared_secret = crypto_pool::instance().get_shared_secret( _priv_key, fc::ecc::public_key(rpub) );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
     _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
                     fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
@@ -1,6 +1,8 @@
 #include <bts/peer/peer_messages.hpp>
 #include <bts/peer/peer_channel.hpp>
 #include <bts/network/broadcast_manager.hpp>
+#include <bts/network/inventory_scheduler.hpp>
+#include <bts/config.hpp>
 #include <bts/db/level_map.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/reflect/variant.hpp>
@@ -72,6 +74,9 @@ namespace bts { namespace peer {
            std::unordered_map<uint32_t,channel_connection_index>  cons_by_channel;
            std::unordered_set<uint32_t>                           subscribed_channels;
 
+           /** codec to use for each channel with peers that support it */
+           std::unordered_map<uint32_t,compression_type>          channel_compression;
+
            /**
             *  Store all hosts we know about sorted by time since we last heard about them.
             *  This list is provided to new nodes when they connect.  Limit to 1000 nodes.
@@ -79,12 +84,14 @@ namespace bts { namespace peer {
            std::vector<host>                                      recent_hosts;
 
            bts::db::level_map<uint64_t,announce_msg>              known_hosts;
+           peer_db_ptr                                            _peer_db;
 
            announce_msg                                           last_announce;
            fc::thread                                             announce_miner_thread;
            fc::future<void>                                       announce_mining_complete;
            
            broadcast_manager<uint64_t,announce_msg>               announce_broadcasts;
+           inventory_scheduler                                    broadcast_scheduler;
 
            void broadcast_inv()
            { try {
@@ -92,8 +99,10 @@ namespace bts { namespace peer {
               {
                  auto con_chan_itr = cons_by_channel.find( _chan_id.id() );
                  auto cons = con_chan_itr->second.get_connections();
+                 bool deferred = false; // congested connections get their inventory on the retry
                  for( auto itr = cons.begin(); itr != cons.end(); ++itr )
                  {
+                    if( (*itr)->is_congested() ) { deferred = true; continue; }
                     announce_inv_msg inv_msg;
                     peer_data& con_data = get_channel_data(*itr);
                     
@@ -108,7 +117,11 @@ namespace bts { namespace peer {
                  // TODO: send() may yield and thus there may in fact be new since
                  // the last broadcast... should I copy state before starting loop 
                  // above?
-                 announce_broadcasts.set_new_since_broadcast(false);
+                 announce_broadcasts.set_new_since_broadcast(deferred);
+                 if( deferred )
+                 {
+                    broadcast_scheduler.notify_at( fc::time_point::now() + fc::milliseconds( NETWORK_CONGESTED_RETRY_MS ) );
+                 }
               }
            } FC_RETHROW_EXCEPTIONS( warn, "error broadcasting announcement inventory" ) }
 
@@ -131,6 +144,11 @@ namespace bts { namespace peer {
                 return false; // too old
               }
 
+              if( _peer_db )
+              {
+                 _peer_db->store( h );
+              }
+
               /** remove any expired hosts while we are at it */
               for( auto itr = recent_hosts.begin(); itr != recent_hosts.end();  )
               {
@@ -160,8 +178,36 @@ namespace bts { namespace peer {
            {
                c->set_channel_data( channel_id( peer_proto ), std::make_shared<peer_data>() );
                ilog( "on connected..." );
+               send_config( c );
                send_subscription_request( c );
            }
+
+           void send_config( const connection_ptr& c )
+           {
+               config_msg cfg;
+               cfg.supported_features.insert( PEER_FEATURE_ZLIB_COMPRESSION );
+               cfg.subscribed_channels = subscribed_channels;
+               cfg.timestamp           = fc::time_point::now();
+               c->send( message( cfg, channel_id( peer_proto ) ) );
+           }
+
+           /**
+            *  Enables compression on c for every channel that requested it, provided 
+            *  the peer has told us it can decompress the messages.
+            */
+           void apply_compression( const connection_ptr& c )
+           {
+               peer_data& pd = get_channel_data( c );
+               if( !pd.peer_config || 
+                   !pd.peer_config->supported_features.count( PEER_FEATURE_ZLIB_COMPRESSION ) )
+               {
+                  return;
+               }
+               for( auto itr = channel_compression.begin(); itr != channel_compression.end(); ++itr )
+               {
+                  c->set_compression( channel_id( itr->first ), itr->second );
+               }
+           }
            peer_data& get_channel_data( const connection_ptr& c )
            {
               return c->get_channel_data( channel_id(peer_proto) )->as<peer_data>(); 
@@ -175,6 +221,10 @@ namespace bts { namespace peer {
                {
                   cons_by_channel[*itr].remove_connection(c.get());
                }
+               if( _peer_db )
+               {
+                  _peer_db->record_bytes_received( c->remote_endpoint(), c->bytes_received() );
+               }
            }
 
            
@@ -289,6 +339,7 @@ namespace bts { namespace peer {
            {
                peer_data& pd = get_channel_data( c );
                pd.peer_config = std::move(cfg);
+               apply_compression( c );
 
                if( recent_hosts.size() < PEER_HOST_CACHE_QUERY_LIMIT )
                {
@@ -350,6 +401,7 @@ namespace bts { namespace peer {
                       // TODO: validate ID is an acceptable / supported channel to prevent
                       // remote hosts from sending us a ton of bogus channels
                       cons_by_channel[itr->id()].add_connection(c.get());
+                      if( _peer_db ) _peer_db->add_channel( c->remote_endpoint(), *itr );
 
                       auto chan_ptr = netw->get_channel( channel_id(itr->id()) );
                       if( chan_ptr != nullptr )
@@ -370,6 +422,7 @@ namespace bts { namespace peer {
                       // TODO: validate ID is an acceptable / supported channel to prevent
                       // remote hosts from sending us a ton of bogus channels
                       cons_by_channel[itr->id()].remove_connection(c.get());
+                      if( _peer_db ) _peer_db->remove_channel( c->remote_endpoint(), *itr );
 
                       auto chan_ptr = netw->get_channel( channel_id(itr->id()) );
                       if( chan_ptr != nullptr )
@@ -412,19 +465,41 @@ namespace bts { namespace peer {
       my->_chan_id = channel_id( peer_proto, 0 );
       s->set_delegate( my.get() );
       subscribe_to_channel( my->_chan_id, my );
+
+      // the scheduler is owned by the impl, a shared_ptr to it would form a cycle
+      auto self = my.get();
+      my->broadcast_scheduler.start( [self](){ self->broadcast_inv(); } );
    }
 
    peer_channel::~peer_channel()
    {
+      try {
+         my->broadcast_scheduler.stop();
+      } 
+      catch ( ... ) 
+      {
+         wlog( "unexpected exception ${e}", ("e", fc::except_str()));
+      }
       my->netw->unsubscribe_from_channel( channel_id(peer_proto) );
    }
 
-   void peer_channel::subscribe_to_channel( const channel_id& chan, const channel_ptr& c )
+   void peer_channel::subscribe_to_channel( const channel_id& chan, const channel_ptr& c, 
+                                            compression_type compress )
    {
       // let the network know to forward messages to c
       my->netw->subscribe_to_channel( chan, c );
       my->subscribed_channels.insert( chan.id() );
 
+      if( compress != no_compression )
+      {
+         my->channel_compression[chan.id()] = compress;
+         auto cons = my->netw->get_connections();
+         for( auto itr = cons.begin(); itr != cons.end(); ++itr )
+         {
+            my->apply_compression( *itr );
+         }
+      }
+
       // let other peers know that we are now subscribed to chan
       subscribe_msg s;
       s.channels.push_back(chan);
@@ -442,6 +517,11 @@ namespace bts { namespace peer {
    }
 
 
+   void peer_channel::set_peer_db( const peer_db_ptr& db )
+   {
+      my->_peer_db = db;
+   }
+
    std::vector<network::connection_ptr> peer_channel::get_connections( const network::channel_id& chan )
    {
       std::vector<network::connection_ptr> cons;
@@ -1,13 +1,140 @@
 #include <bts/peer/peer_db.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/config.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <unordered_map>
 
 namespace bts { namespace peer {
 
+  host::host( const fc::ip::endpoint& ep, const network::channel_id& c, const fc::time_point_sec& t )
+  :ep(ep),last_com(t),first_com(t)
+  {
+     channels.push_back(c);
+  }
+
+  /**
+   *  The score favors hosts we have connected to reliably and that answered 
+   *  the handshake quickly.  Hosts that have never been tried score in the 
+   *  middle so that new hosts are still explored, and hosts that keep failing 
+   *  are backed off exponentially.
+   */
+  double host_record::score( const fc::time_point& now )const
+  {
+     if( failure_count )
+     {
+        int64_t backoff_sec = std::min<int64_t>( int64_t(PEER_RETRY_BACKOFF_SEC) << std::min<uint32_t>( failure_count - 1, 16 ), 
+                                                 PEER_MAX_RETRY_BACKOFF_SEC );
+        if( now < fc::time_point(last_attempt) + fc::seconds( backoff_sec ) )
+        {
+           return 0;
+        }
+     }
+
+     double freshness = (now - fc::time_point(info.last_com)) < fc::seconds(60*60*3) ? 1.0 : 0.5;
+     return quality() * freshness;
+  }
+
+  double host_record::quality()const
+  {
+     double reliability = (connect_count + 1.0) / (connect_count + failure_count + 2.0);
+     double speed       = 0.5; // unknown
+     if( handshake_rtt_us > 0 )
+     {
+        speed = 1.0 / (1.0 + handshake_rtt_us / double(PEER_TARGET_HANDSHAKE_US));
+     }
+     double usefulness  = 1.0 + std::log10( 1.0 + bytes_received / (1024*1024.0) ) / 10.0;
+
+     return std::max( 1e-9, reliability * speed * usefulness );
+  }
+
   namespace detail 
   {
+    /**
+     *  Every record is also kept in memory and indexed by quality so that choosing
+     *  hosts to dial and evicting hosts does not read the whole db.
+     */
     class peer_db_impl
     {
       public:
+         typedef std::multimap<double,fc::ip::endpoint> quality_index;
+         struct indexed_record
+         {
+            host_record             rec;
+            quality_index::iterator quality_itr;
+         };
+
+         bts::db::level_map<fc::ip::endpoint,host_record>           _hosts;
+         std::unordered_map<fc::ip::endpoint,indexed_record>        _records;
+         quality_index                                              _by_quality;
+
+         fc::optional<host_record> find( const fc::ip::endpoint& ep )
+         {
+            auto itr = _records.find( ep );
+            if( itr != _records.end() ) return itr->second.rec;
+            return fc::optional<host_record>();
+         }
+
+         /** stores rec in memory and in the db */
+         void put( const fc::ip::endpoint& ep, const host_record& rec )
+         {
+            index( ep, rec );
+            _hosts.store( ep, rec );
+         }
+
+         /** stores rec in memory only */
+         void index( const fc::ip::endpoint& ep, const host_record& rec )
+         {
+            auto itr = _records.find( ep );
+            if( itr == _records.end() )
+            {
+               itr = _records.insert( std::make_pair( ep, indexed_record() ) ).first;
+            }
+            else
+            {
+               _by_quality.erase( itr->second.quality_itr );
+            }
+            itr->second.rec         = rec;
+            itr->second.quality_itr = _by_quality.insert( std::make_pair( rec.quality(), ep ) );
+         }
+
+         void erase( const fc::ip::endpoint& ep )
+         {
+            auto itr = _records.find( ep );
+            if( itr == _records.end() ) return;
+            _by_quality.erase( itr->second.quality_itr );
+            _records.erase( itr );
+            _hosts.remove( ep );
+         }
+
+         /** 
+          *  Evicts the lowest quality hosts until there is room for one more.
+          *  @return false if the hosts that would be evicted are better than quality 
+          */
+         bool make_room( double quality )
+         {
+            while( _records.size() >= PEER_DB_MAX_HOSTS )
+            {
+               if( _by_quality.begin()->first > quality ) return false;
+               erase( fc::ip::endpoint( _by_quality.begin()->second ) );
+            }
+            return true;
+         }
 
+         /** applies f to the record for ep if we know about it */
+         template<typename Functor>
+         void update( const fc::ip::endpoint& ep, Functor&& f )
+         {
+            auto rec = find( ep );
+            if( !rec ) return;
+            f( *rec );
+            put( ep, *rec );
+         }
     };
 
   }
@@ -17,13 +144,31 @@ namespace bts { namespace peer {
   {
   }
 
-
   peer_db::~peer_db(){}
+
   void peer_db::open( const fc::path& dbdir, bool create )
-  {
-  }
+  { try {
+     my->_hosts.open( dbdir / "hosts", create );
+     my->_records.clear();
+     my->_by_quality.clear();
+
+     std::vector<std::pair<fc::ip::endpoint,host_record> > stored;
+     for( auto itr = my->_hosts.begin(); itr.valid(); ++itr )
+     {
+        stored.push_back( std::make_pair( itr.key(), itr.value() ) );
+     }
+     for( auto itr = stored.begin(); itr != stored.end(); ++itr )
+     {
+        if( my->make_room( itr->second.quality() ) ) my->index( itr->first, itr->second );
+        else                                         my->_hosts.remove( itr->first );
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("dir",dbdir) ) }
+
   void peer_db::close()
   {
+     my->_hosts.close();
+     my->_records.clear();
+     my->_by_quality.clear();
   }
 
   /**
@@ -32,17 +177,51 @@ namespace bts { namespace peer {
    *  not heard about them in 2 hours.
    */
   void                peer_db::reset_ages( const fc::time_point_sec& s )
-  {
-  }
+  { try {
+     for( auto itr = my->_records.begin(); itr != my->_records.end(); ++itr )
+     {
+        if( itr->second.rec.info.last_com > s )
+        {
+           itr->second.rec.info.last_com = s;
+           my->_hosts.store( itr->first, itr->second.rec );
+        }
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
   void                peer_db::store( const host& r )
-  {
-  }
+  { try {
+     auto rec = my->find( r.ep );
+     if( !rec )
+     {
+        rec = host_record();
+        rec->info           = r;
+        rec->info.first_com = fc::time_point::now();
+        rec->info.last_com  = rec->info.first_com;
+        if( !my->make_room( rec->quality() ) )
+        {
+           return;
+        }
+     }
+     else
+     {
+        for( auto itr = r.channels.begin(); itr != r.channels.end(); ++itr )
+        {
+           if( std::find( rec->info.channels.begin(), rec->info.channels.end(), *itr ) == rec->info.channels.end() )
+           {
+              rec->info.channels.push_back( *itr );
+           }
+        }
+        if( r.features.size() ) rec->info.features = r.features;
+     }
+     my->put( r.ep, *rec );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("host",r) ) }
 
-  host                peer_db::fetch_record( const fc::ip::endpoint& ep )
-  {
-    return host();
-  }
+  host_record         peer_db::fetch_record( const fc::ip::endpoint& ep )
+  { try {
+     auto rec = my->find( ep );
+     FC_ASSERT( rec, "unknown host" );
+     return *rec;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("ep",ep) ) }
 
   /**  Removes a host from the DB, presumably because we attempted to connect 
    * to it and were unable to.  
@@ -52,26 +231,122 @@ namespace bts { namespace peer {
    *   connected to other nodes.
    */
   void                peer_db::remove( const fc::ip::endpoint& ep )
-  {
-  }
+  { try {
+     my->erase( ep );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("ep",ep) ) }
 
   void                peer_db::add_channel( const fc::ip::endpoint& e, const channel_id& c )
   {
+     my->update( e, [&]( host_record& rec )
+     {
+        if( std::find( rec.info.channels.begin(), rec.info.channels.end(), c ) == rec.info.channels.end() )
+        {
+           rec.info.channels.push_back( c );
+        }
+     });
   }
 
   void                peer_db::remove_channel( const fc::ip::endpoint& e, const channel_id& c )
   {
+     my->update( e, [&]( host_record& rec )
+     {
+        rec.info.channels.erase( std::remove( rec.info.channels.begin(), rec.info.channels.end(), c ), 
+                                 rec.info.channels.end() );
+     });
   }
 
+  void                peer_db::record_connected( const fc::ip::endpoint& ep, const fc::microseconds& handshake_rtt )
+  { try {
+     auto rec = my->find( ep );
+     if( !rec )
+     {
+        rec = host_record();
+        rec->info = host( ep, channel_id( network::peer_proto ) );
+        my->make_room( std::numeric_limits<double>::max() ); // a host we reached is worth keeping
+     }
+     // weighted average so one slow handshake does not ruin a good host
+     rec->handshake_rtt_us = rec->handshake_rtt_us ? (3*rec->handshake_rtt_us + handshake_rtt.count()) / 4 
+                                                   : handshake_rtt.count();
+     rec->connect_count++;
+     rec->failure_count = 0;
+     rec->last_attempt  = fc::time_point::now();
+     rec->info.last_com = rec->last_attempt;
+     my->put( ep, *rec );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("ep",ep) ) }
 
-  std::vector<host>   peer_db::fetch_hosts( const channel_id& c )
+  void                peer_db::record_failure( const fc::ip::endpoint& ep )
   {
-    return std::vector<host>();
+     my->update( ep, [&]( host_record& rec )
+     {
+        rec.failure_count++;
+        rec.last_attempt = fc::time_point::now();
+     });
   }
 
-  void                peer_db::purge_old( const fc::time_point& age )
+  void                peer_db::record_bytes_received( const fc::ip::endpoint& ep, uint64_t bytes )
   {
+     my->update( ep, [&]( host_record& rec )
+     {
+        rec.bytes_received += bytes;
+        rec.info.last_com   = fc::time_point::now();
+     });
   }
 
+  std::vector<host>   peer_db::fetch_hosts( const channel_id& c, uint32_t limit )
+  { try {
+     auto now = fc::time_point::now();
+
+     // best first, a host's score never exceeds its quality so the walk can stop once 
+     // the quality drops below the worst score that is kept
+     std::vector<std::pair<double,const host*> > best;
+     auto better = []( const std::pair<double,const host*>& a, const std::pair<double,const host*>& b ){ return a.first > b.first; };
+     for( auto itr = my->_by_quality.rbegin(); itr != my->_by_quality.rend() && limit; ++itr )
+     {
+        if( best.size() == limit && itr->first <= best.back().first )
+        {
+           break;
+        }
+        const host_record& rec = my->_records.find( itr->second )->second.rec;
+        if( c.proto != network::peer_proto && 
+            std::find( rec.info.channels.begin(), rec.info.channels.end(), c ) == rec.info.channels.end() )
+        {
+           continue;
+        }
+        auto scored = std::make_pair( rec.score( now ), &rec.info );
+        if( scored.first <= 0 || (best.size() == limit && scored.first <= best.back().first) )
+        {
+           continue;
+        }
+        if( best.size() == limit ) 
+        {
+           best.pop_back();
+        }
+        best.insert( std::upper_bound( best.begin(), best.end(), scored, better ), scored );
+     }
+
+     std::vector<host> result;
+     result.reserve( best.size() );
+     for( auto itr = best.begin(); itr != best.end(); ++itr )
+     {
+        result.push_back( *itr->second );
+     }
+     return result;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("channel",c)("limit",limit) ) }
+
+  void                peer_db::purge_old( const fc::time_point& age )
+  { try {
+     std::vector<fc::ip::endpoint> old;
+     for( auto itr = my->_records.begin(); itr != my->_records.end(); ++itr )
+     {
+        if( fc::time_point(itr->second.rec.info.last_com) < age )
+        {
+           old.push_back( itr->first );
+        }
+     }
+     for( auto itr = old.begin(); itr != old.end(); ++itr )
+     {
+        my->erase( *itr );
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("age",age) ) }
 
 } }
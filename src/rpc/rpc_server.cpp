@@ -1,9 +1,11 @@
 #include <bts/rpc/rpc_server.hpp>
 #include <fc/reflect/variant.hpp>
+#include <fc/variant_object.hpp>
 #include <fc/network/tcp_socket.hpp>
 #include <fc/rpc/json_connection.hpp>
 #include <fc/thread/thread.hpp>
 #include <bts/application.hpp>
+#include <bts/network/message_buffer_pool.hpp>
 
 using namespace fc;
 
@@ -213,6 +215,19 @@ namespace bts { namespace rpc {
                 return fc::variant(endpoints);
             });
 
+            /**
+             *  params : []
+             *  result : { "hits" : N, "misses" : N, "released" : N, "discarded" : N, "pooled_bytes" : N, "hit_rate" : R }
+             */
+            con->add_method( "get_buffer_pool_stats", [=]( const fc::variants& params ) -> fc::variant 
+            {
+                check_login( capture_con );
+                auto stats = bts::network::message_buffer_pool::instance().get_stats();
+                fc::mutable_variant_object result( fc::variant( stats ).get_object() );
+                result["hit_rate"] = stats.hit_rate();
+                return fc::variant( result );
+            });
+
          }
     };
   } // detail
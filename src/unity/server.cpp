@@ -75,12 +75,13 @@ namespace unity
              void broadcast( const mail::message& msg )
              {
                 auto cons_copy = _connections;
-                fc::async( [cons_copy,msg]()
+                auto packed    = mail::pack_message( msg );
+                fc::async( [cons_copy,packed]()
                 {
                    for( auto itr = cons_copy.begin(); itr != cons_copy.end(); ++itr )
                    {
                       try {
-                         itr->second->send( msg );
+                         itr->second->send( packed );
                       } catch ( ... ) {}
                    }
                 } ).wait();
@@ -3,10 +3,12 @@
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/db/level_map.hpp>
 #include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
 #include <fc/reflect/variant.hpp>
 
 #include <unordered_map>
 #include <map>
+#include <set>
 
 struct output_balance
 {
@@ -24,11 +26,50 @@ bool operator < ( const output_balance& a, const output_balance& b )
 
 FC_REFLECT( output_balance, (unit)(amount) )
 
+/**
+ *  Key of the address history index, sorted by address and then by
+ *  the location of the transaction in the chain.
+ */
+struct address_trx_key
+{
+   address_trx_key(){}
+   address_trx_key( const bts::address& a, const bts::blockchain::trx_num& n )
+   :addr(a),num(n){}
+
+   bts::address               addr;
+   bts::blockchain::trx_num   num;
+};
+
+bool operator < ( const address_trx_key& a, const address_trx_key& b )
+{
+   if( a.addr < b.addr ) return true;
+   if( b.addr < a.addr ) return false;
+   return a.num < b.num;
+}
+
+bool operator == ( const address_trx_key& a, const address_trx_key& b )
+{
+   return a.addr == b.addr && a.num == b.num;
+}
+
+struct address_trx_record
+{
+   bts::blockchain::transaction_id_type trx_id;
+};
+
+FC_REFLECT( address_trx_key, (addr)(num) )
+FC_REFLECT( address_trx_record, (trx_id) )
+
 namespace bts {
   using namespace blockchain;
 
   namespace detail 
   {
+     /** number of unused addresses kept indexed past the last used address of a trx */
+     const uint32_t address_gap_limit = 20;
+     /** number of unused trx keys kept indexed past the last used trx of an account */
+     const uint32_t trx_gap_limit     = 10;
+
      class wallet_cache_impl
      {
         public:
@@ -46,6 +87,15 @@ namespace bts {
           /** maps account.trx number to the last recv used */
           db::level_map<uint64_t,uint32_t>             _trx_last_address_index;
 
+          /** every confirmed transaction that references one of our addresses, by address */
+          db::level_map<address_trx_key,address_trx_record> _addr_trxs;
+
+          /** all outputs that pay one of our addresses and have not been spent */
+          db::level_map<output_reference,trx_output>   _unspent;
+
+          /** wallet wide properties, such as the last block indexed */
+          db::level_map<std::string,uint32_t>          _properties;
+
           /** store all outputs that reference a particular address derived from
            *  our HD Wallet, in this case the value is the index of the value[i].output_idx 
            *  is really the input idx because the data for an input ref is the same
@@ -56,9 +106,10 @@ namespace bts {
           /** stores all unspent outputs that can be claimed by a signature sorted by
            * unit & value.  This is rebuilt / updated every time a new block is added
            */
-          std::map<output_balance, output_reference> _unspent_claim_by_sig;
+          std::multimap<output_balance, output_reference> _unspent_claim_by_sig;
 
-          // TODO:  index spendable.... 
+          /** running total of _unspent_claim_by_sig per unit */
+          std::map<asset::type, asset>                 _balances;
           
           // TODO:  index margin (short) positions
 
@@ -67,6 +118,108 @@ namespace bts {
           // TODO:  index password outputs... 
 
           // TODO:  index open orders
+
+          static uint64_t trx_key( uint32_t account, uint32_t trx )
+          {
+             return (uint64_t(account) << 32) | trx;
+          }
+
+          uint32_t last_indexed_block()
+          {
+             auto itr = _properties.find( "last_indexed_block" );
+             return itr.valid() ? itr.value() : INVALID_BLOCK_NUM;
+          }
+
+          /** @return the address that owns out, if any */
+          static fc::optional<bts::address> get_owner( const trx_output& out )
+          {
+             switch( out.claim_func )
+             {
+                case claim_by_signature:
+                   return out.as<claim_by_signature_output>().owner;
+                case claim_by_bid:
+                   return out.as<claim_by_bid_output>().pay_address;
+                case claim_by_long:
+                   return out.as<claim_by_long_output>().pay_address;
+                case claim_by_cover:
+                   return out.as<claim_by_cover_output>().owner;
+                default:
+                   return fc::optional<bts::address>();
+             }
+          }
+
+          void add_unspent( const output_reference& ref, const trx_output& out )
+          {
+             if( _unspent.find( ref ).valid() )
+             {
+                return;
+             }
+             _unspent.store( ref, out );
+             cache_unspent( ref, out );
+          }
+
+          void cache_unspent( const output_reference& ref, const trx_output& out )
+          {
+             if( out.claim_func != claim_by_signature )
+             {
+                return;
+             }
+             output_balance bal;
+             bal.unit   = out.amount.unit;
+             bal.amount = out.amount.get_rounded_amount();
+             _unspent_claim_by_sig.insert( std::make_pair( bal, ref ) );
+
+             auto itr = _balances.find( out.amount.unit );
+             if( itr == _balances.end() )
+             {
+                _balances[out.amount.unit] = out.amount;
+             }
+             else
+             {
+                itr->second += out.amount;
+             }
+          }
+
+          /** @return the owner of the output that was spent */
+          fc::optional<bts::address> remove_unspent( const output_reference& ref )
+          {
+             auto itr = _unspent.find( ref );
+             if( !itr.valid() )
+             {
+                return fc::optional<bts::address>();
+             }
+             trx_output out = itr.value();
+             _unspent.remove( ref );
+
+             if( out.claim_func == claim_by_signature )
+             {
+                output_balance bal;
+                bal.unit   = out.amount.unit;
+                bal.amount = out.amount.get_rounded_amount();
+                auto range = _unspent_claim_by_sig.equal_range( bal );
+                for( auto sitr = range.first; sitr != range.second; ++sitr )
+                {
+                   if( sitr->second == ref )
+                   {
+                      _unspent_claim_by_sig.erase( sitr );
+                      break;
+                   }
+                }
+                _balances[out.amount.unit] = _balances[out.amount.unit] - out.amount;
+             }
+             return get_owner( out );
+          }
+
+          /**
+           *  Keeps address_gap_limit unused addresses indexed after idx and trx_gap_limit
+           *  unused trx keys after idx.trx_num, so that funds sent to the next addresses
+           *  will be found.
+           */
+          void extend_gap( wallet_cache& self, const address_index& idx )
+          {
+             self.index_account_trx_addresses( idx.account_num, idx.trx_num, idx.address_num + address_gap_limit + 1 );
+             self.index_account_trx( idx.account_num, idx.trx_num + trx_gap_limit + 1, address_gap_limit );
+          }
      };
   } // namespace detail
 
@@ -92,9 +245,18 @@ namespace bts {
       my->_addr_index.open( wallet_cache_dir / "addr_index", true );
       my->_account_last_trx_index.open( wallet_cache_dir / "acnt_last_trx_index", true );
       my->_trx_last_address_index.open( wallet_cache_dir / "trx_last_address_index", true );
+      my->_addr_trxs.open( wallet_cache_dir / "addr_trxs", true );
+      my->_unspent.open( wallet_cache_dir / "unspent", true );
+      my->_properties.open( wallet_cache_dir / "properties", true );
       
       // TODO generate _spent_outputs cache... 
-      // TODO generate unspent_claim_by_sig cache
+
+      my->_unspent_claim_by_sig.clear();
+      my->_balances.clear();
+      for( auto itr = my->_unspent.begin(); itr.valid(); ++itr )
+      {
+         my->cache_unspent( itr.key(), itr.value() );
+      }
 
   } FC_RETHROW_EXCEPTIONS( warn, "", ("wallet_cache_dir",wallet_cache_dir) ) }
 
@@ -103,22 +265,98 @@ namespace bts {
    *  This method will scan the trx for inputs or outputs
    *  that belong to this wallet.
    */
-  void  wallet_cache::cache( const blockchain::signed_transaction& trx )
+  void  wallet_cache::cache( const blockchain::signed_transaction& trx, const trx_num& num )
+  { try {
+     std::set<bts::address> touched;
+     auto trx_id = trx.id();
+
+     for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+     {
+        auto owner = my->remove_unspent( itr->output_ref );
+        if( owner )
+        {
+           touched.insert( *owner );
+        }
+     }
+
+     for( uint16_t out_idx = 0; out_idx < trx.outputs.size(); ++out_idx )
+     {
+        auto owner = my->get_owner( trx.outputs[out_idx] );
+        if( !owner )
+        {
+           continue;
+        }
+        auto idx_itr = my->_addr_index.find( *owner );
+        if( !idx_itr.valid() )
+        {
+           continue;
+        }
+        touched.insert( *owner );
+        my->add_unspent( output_reference( trx_id, out_idx ), trx.outputs[out_idx] );
+        my->extend_gap( *this, idx_itr.value() );
+     }
+
+     if( touched.size() == 0 )
+     {
+        return;
+     }
+     my->_trx_db.store( trx_id, trx );
+
+     if( num.block_num != trx_num::invalid_block_id )
+     {
+        address_trx_record rec;
+        rec.trx_id = trx_id;
+        for( auto itr = touched.begin(); itr != touched.end(); ++itr )
+        {
+           my->_addr_trxs.store( address_trx_key( *itr, num ), rec );
+        }
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx)("num",num) ) }
+
+  asset wallet_cache::get_balance( asset::type unit )const
   {
-     // TODO:  scan trx for addresses that belong to this wallet.
-     my->_trx_db.store( trx.id(), trx );
+    auto itr = my->_balances.find( unit );
+    if( itr == my->_balances.end() )
+    {
+       return asset( static_cast<uint64_t>(0ull), unit );
+    }
+    return itr->second;
   }
 
-  asset wallet_cache::get_balance( asset::type unit )const
+  std::vector<transaction_id_type> wallet_cache::get_address_history( const bts::address& addr )
+  { try {
+    std::vector<transaction_id_type> history;
+    auto itr = my->_addr_trxs.lower_bound( address_trx_key( addr, trx_num(0,0) ) );
+    while( itr.valid() && itr.key().addr == addr )
+    {
+       history.push_back( itr.value().trx_id );
+       ++itr;
+    }
+    return history;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("addr",addr) ) }
+
+  std::vector<signed_transaction> wallet_cache::get_address_transactions( const bts::address& addr )
+  { try {
+    std::vector<signed_transaction> trxs;
+    auto ids = get_address_history( addr );
+    trxs.reserve( ids.size() );
+    for( auto itr = ids.begin(); itr != ids.end(); ++itr )
+    {
+       trxs.push_back( my->_trx_db.fetch( *itr ) );
+    }
+    return trxs;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("addr",addr) ) }
+
+  bool wallet_cache::is_my_address( const bts::address& addr )
   {
-    return asset();
+    return my->_addr_index.find( addr ).valid();
   }
 
   void wallet_cache::add_account( uint32_t account, const extended_public_key& pub )
   { try {
 
      my->_accounts.store( account, pub );
-     index_account_trx( account, 10, 10 ); // TODO: don't hardcode these numbers
+     index_account_trx( account, detail::trx_gap_limit, detail::address_gap_limit );
 
   } FC_RETHROW_EXCEPTIONS( warn, "error adding account ${a} = ${k}", ("a", account)("k",pub) ) }
 
@@ -129,17 +367,79 @@ namespace bts {
 
   } FC_RETHROW_EXCEPTIONS( warn, "error removing account ${a} = ${k}", ("a", account) ) }
 
+  /**
+   *  Forgets everything that was learned from the chain and indexes it again
+   *  from the genesis block.
+   */
   void wallet_cache::rescan_chain()
-  {
-  }
+  { try {
+     while( true )
+     {
+        auto itr = my->_unspent.begin();
+        if( !itr.valid() ) break;
+        my->_unspent.remove( itr.key() );
+     }
+     my->_unspent_claim_by_sig.clear();
+     my->_balances.clear();
+     my->_properties.store( "last_indexed_block", INVALID_BLOCK_NUM );
+     index_new_blocks();
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void wallet_cache::index_new_blocks()
+  { try {
+     FC_ASSERT( !!my->_block_db );
+     uint32_t head = my->_block_db->head_block_num();
+     if( head == INVALID_BLOCK_NUM )
+     {
+        return;
+     }
+
+     uint32_t last = my->last_indexed_block();
+     uint32_t first = last == INVALID_BLOCK_NUM ? 0 : last + 1;
+     for( uint32_t block_num = first; block_num <= head; ++block_num )
+     {
+        auto blk = my->_block_db->fetch_full_block( block_num );
+        bool pruned = my->_block_db->is_block_pruned( block_num );
+        for( uint16_t trx_idx = 0; trx_idx < blk.trx_ids.size(); ++trx_idx )
+        {
+           trx_num num( block_num, trx_idx );
+           if( pruned && !my->_block_db->has_trx( num ) )
+           {
+              continue; // all of its outputs were spent long ago
+           }
+           cache( my->_block_db->fetch_trx( num ), num );
+        }
+        my->_properties.store( "last_indexed_block", block_num );
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
   void wallet_cache::index_account_trx( uint32_t account, uint32_t trx_limit, uint32_t adr_limit )
-  {
-  }
+  { try {
+     auto last_itr = my->_account_last_trx_index.find( account );
+     uint32_t first_trx = last_itr.valid() ? last_itr.value() + 1 : 0;
+     for( uint32_t trx = first_trx; trx < trx_limit; ++trx )
+     {
+        index_account_trx_addresses( account, trx, adr_limit );
+        my->_account_last_trx_index.store( account, trx );
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("account",account)("trx_limit",trx_limit)("adr_limit",adr_limit) ) }
 
   void wallet_cache::index_account_trx_addresses( uint32_t account, uint32_t trx, uint32_t adr_limit )
-  {
-  }
+  { try {
+     auto key = detail::wallet_cache_impl::trx_key( account, trx );
+     auto last_itr = my->_trx_last_address_index.find( key );
+     uint32_t first_addr = last_itr.valid() ? last_itr.value() + 1 : 0;
+     if( first_addr >= adr_limit )
+     {
+        return;
+     }
 
-} // namespace bts
+     auto trx_pub = my->_accounts.fetch( account ).child( trx );
+     for( uint32_t addr = first_addr; addr < adr_limit; ++addr )
+     {
+        my->_addr_index.store( bts::address( trx_pub.child( addr ).pub_key ), address_index( account, trx, addr ) );
+     }
+     my->_trx_last_address_index.store( key, adr_limit - 1 );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("account",account)("trx",trx)("adr_limit",adr_limit) ) }
 
+} // namespace bts
@@ -0,0 +1,74 @@
+#define BOOST_TEST_MODULE BloomFilterTest
+#include <boost/test/unit_test.hpp>
+
+#include <bts/bloom_filter.hpp>
+
+BOOST_AUTO_TEST_CASE( bloom_filter_has_no_false_negatives )
+{
+   bts::bloom_filter filter( 1000, 0.001 );
+   for( uint64_t i = 0; i < 1000; ++i )
+   {
+      filter.insert( i );
+   }
+   for( uint64_t i = 0; i < 1000; ++i )
+   {
+      BOOST_REQUIRE( filter.contains( i ) );
+   }
+   BOOST_REQUIRE( filter.size() == 1000 );
+   BOOST_REQUIRE( !filter.is_saturated() );
+
+   uint32_t false_positives = 0;
+   for( uint64_t i = 1000; i < 11000; ++i )
+   {
+      false_positives += filter.contains( i );
+   }
+   BOOST_REQUIRE( false_positives < 100 ); // 10x the expected rate
+
+   filter.clear();
+   BOOST_REQUIRE( filter.size() == 0 );
+   BOOST_REQUIRE( !filter.contains( uint64_t(1) ) );
+}
+
+BOOST_AUTO_TEST_CASE( rolling_filter_remembers_one_full_generation )
+{
+   bts::rolling_bloom_filter filter( 100, 0.001, fc::hours(1) );
+   for( uint64_t i = 0; i < 100; ++i )
+   {
+      filter.insert( i );
+   }
+   filter.insert( uint64_t(100) ); // rotates, the first generation becomes the previous filter
+   for( uint64_t i = 0; i <= 100; ++i )
+   {
+      BOOST_REQUIRE( filter.contains( i ) );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( rolling_filter_forgets_after_two_generations )
+{
+   bts::rolling_bloom_filter filter( 100, 0.001, fc::hours(1) );
+   for( uint64_t i = 0; i < 201; ++i )
+   {
+      filter.insert( i );
+   }
+   // items 100 - 200 are remembered, the first generation was dropped on the second rotation
+   for( uint64_t i = 100; i < 201; ++i )
+   {
+      BOOST_REQUIRE( filter.contains( i ) );
+   }
+   uint32_t remembered = 0;
+   for( uint64_t i = 0; i < 100; ++i )
+   {
+      remembered += filter.contains( i );
+   }
+   BOOST_REQUIRE( remembered < 10 );
+
+   size_t memory = filter.memory_usage();
+   for( uint64_t i = 201; i < 10000; ++i )
+   {
+      filter.insert( i );
+   }
+   BOOST_REQUIRE( filter.memory_usage() == memory );
+
+   filter.clear();
+   BOOST_REQUIRE( !filter.contains( uint64_t(9999) ) );
+}
@@ -0,0 +1,66 @@
+#define BOOST_TEST_MODULE MessageBufferPoolTest
+#include <boost/test/unit_test.hpp>
+
+#include <bts/network/message_buffer_pool.hpp>
+
+using namespace bts::network;
+
+BOOST_AUTO_TEST_CASE( acquire_rounds_capacity_to_size_class )
+{
+   message_buffer_pool pool( 1024*1024 );
+   auto buf = pool.acquire( 300 );
+   BOOST_REQUIRE( buf.size() == 300 );
+   BOOST_REQUIRE( buf.capacity() >= 512 );
+
+   auto small = pool.acquire( 1 );
+   BOOST_REQUIRE( small.size() == 1 );
+   BOOST_REQUIRE( small.capacity() >= 256 );
+   BOOST_REQUIRE( pool.get_stats().misses == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( released_buffers_are_reused )
+{
+   message_buffer_pool pool( 1024*1024 );
+   auto buf = pool.acquire( 1000 );
+   const char* storage = buf.data();
+   pool.release( std::move(buf) );
+   BOOST_REQUIRE( pool.get_stats().released == 1 );
+   BOOST_REQUIRE( pool.get_stats().pooled_bytes >= 1024 );
+
+   auto again = pool.acquire( 700 );
+   BOOST_REQUIRE( again.data() == storage );
+   BOOST_REQUIRE( again.size() == 700 );
+
+   auto stats = pool.get_stats();
+   BOOST_REQUIRE( stats.hits == 1 );
+   BOOST_REQUIRE( stats.pooled_bytes == 0 );
+   BOOST_REQUIRE( stats.hit_rate() == 0.5 );
+}
+
+BOOST_AUTO_TEST_CASE( pool_size_is_bounded )
+{
+   message_buffer_pool pool( 4096 );
+   pool.release( pool.acquire( 4096 ) );
+   pool.release( pool.acquire( 4096 ) ); // a hit, reuses the buffer released above
+
+   auto first  = pool.acquire( 4096 );   // a hit
+   auto second = pool.acquire( 4096 );   // a miss, the pool holds a single buffer
+   pool.release( std::move(first) );
+   pool.release( std::move(second) ); // would exceed 4096 pooled bytes
+
+   auto stats = pool.get_stats();
+   BOOST_REQUIRE( stats.hits == 2 );
+   BOOST_REQUIRE( stats.misses == 2 );
+   BOOST_REQUIRE( stats.discarded == 1 );
+   BOOST_REQUIRE( stats.pooled_bytes <= 4096 );
+}
+
+BOOST_AUTO_TEST_CASE( tiny_buffers_are_discarded )
+{
+   message_buffer_pool pool( 1024*1024 );
+   std::vector<char> tiny;
+   tiny.reserve( 16 );
+   pool.release( std::move(tiny) );
+   BOOST_REQUIRE( pool.get_stats().discarded == 1 );
+   BOOST_REQUIRE( pool.get_stats().pooled_bytes == 0 );
+}
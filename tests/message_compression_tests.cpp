@@ -0,0 +1,73 @@
+#define BOOST_TEST_MODULE MessageCompressionTest
+#include <boost/test/unit_test.hpp>
+
+#include <bts/network/message.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <zlib.h>
+
+using namespace bts::network;
+
+message make_message( const std::vector<char>& data )
+{
+   message m;
+   m.proto    = 1;
+   m.chan_num = 2;
+   m.msg_type = 3;
+   m.data     = data;
+   m.size     = data.size();
+   return m;
+}
+
+/** a compressed message whose data inflates to size bytes */
+message make_compressed( size_t size )
+{
+   std::vector<char> raw( size, 'x' );
+   uLongf len = compressBound( raw.size() );
+   std::vector<char> data( len );
+   BOOST_REQUIRE( compress2( (Bytef*)data.data(), &len, (const Bytef*)raw.data(), raw.size(), Z_BEST_COMPRESSION ) == Z_OK );
+   data.resize( len );
+
+   message m = make_message( data );
+   m.msg_type |= MESSAGE_COMPRESSED_FLAG;
+   return m;
+}
+
+BOOST_AUTO_TEST_CASE( round_trip )
+{
+   std::vector<char> data( 64*1024 );
+   for( size_t i = 0; i < data.size(); ++i ) data[i] = char(i % 13);
+
+   auto compressed = compress_message( make_message( data ), zlib_compression );
+   BOOST_REQUIRE( compressed );
+   BOOST_REQUIRE( compressed->msg_type == (3 | MESSAGE_COMPRESSED_FLAG) );
+   BOOST_REQUIRE( compressed->size < data.size() );
+   BOOST_REQUIRE( decompress_data( *compressed ) == data );
+}
+
+BOOST_AUTO_TEST_CASE( incompressible_data_is_not_compressed )
+{
+   std::vector<char> data( 4096 );
+   uint32_t x = 12345;
+   for( size_t i = 0; i < data.size(); ++i ) 
+   {
+      x = x * 1103515245 + 12345;
+      data[i] = char(x >> 16);
+   }
+   BOOST_REQUIRE( !compress_message( make_message( data ), zlib_compression ) );
+}
+
+BOOST_AUTO_TEST_CASE( oversized_output_is_rejected )
+{
+   BOOST_REQUIRE( decompress_data( make_compressed( (1<<24) - 1 ) ).size() == (1<<24) - 1 );
+   BOOST_REQUIRE_THROW( decompress_data( make_compressed( 1<<24 ) ), fc::exception );
+   BOOST_REQUIRE_THROW( decompress_data( make_compressed( 64<<20 ) ), fc::exception );
+}
+
+BOOST_AUTO_TEST_CASE( truncated_data_is_rejected )
+{
+   auto m = make_compressed( 100000 );
+   m.data.resize( m.data.size() / 2 );
+   m.size = m.data.size();
+   BOOST_REQUIRE_THROW( decompress_data( m ), fc::exception );
+}
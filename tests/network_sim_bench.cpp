@@ -0,0 +1,436 @@
+#include <bts/network/server.hpp>
+#include <bts/network/inventory_scheduler.hpp>
+#include <bts/peer/peer_channel.hpp>
+#include <bts/blockchain/blockchain_channel.hpp>
+#include <bts/bitname/bitname_channel.hpp>
+#include <bts/bitchat/bitchat_channel.hpp>
+#include <bts/bitchat/bitchat_private_message.hpp>
+#include <bts/address.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/network/ip.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+
+/**
+ *  Starts several complete nodes (server, peer, blockchain, bitname and bitchat
+ *  channels) in this process and connects them over loopback through links that
+ *  add latency, limit bandwidth and simulate packet loss.  Blocks and chat
+ *  messages are injected at one node and the time until every other node has
+ *  them is reported, along with the bytes each node moved and the CPU time spent
+ *  per delivered item.
+ *
+ *  network_sim_bench [nodes] [degree] [latency_ms] [kbytes_per_sec] [loss_percent] [blocks] [messages]
+ */
+
+using namespace bts;
+using namespace bts::blockchain;
+
+struct link_profile
+{
+   fc::microseconds latency;
+   uint64_t         bytes_per_sec;
+   double           loss;
+};
+
+/**
+ *  Forwards a TCP stream from a local port to remote.  Data read from either
+ *  side is held until it would have crossed a link described by the profile.
+ *  TCP hides lost packets, so loss shows up as a retransmit delay that holds
+ *  back everything behind the lost chunk.
+ */
+class shaped_link
+{
+   public:
+      shaped_link( const link_profile& p, uint16_t port, const fc::ip::endpoint& remote, uint32_t seed )
+      :_profile(p),_port(port),_remote(remote),_rng(seed)
+      {
+         _server.listen( port );
+         _accept_complete = fc::async( [=](){ accept(); } );
+      }
+
+      ~shaped_link()
+      {
+         _server.close();
+         _local.close();
+         _peer.close();
+         for( uint32_t i = 0; i < 2; ++i )
+         {
+            _dirs[i].deliver.stop();
+            if( _dirs[i].read_complete.valid() )
+            {
+               try { _dirs[i].read_complete.wait(); } catch ( ... ) {}
+            }
+         }
+         try { _accept_complete.wait(); } catch ( ... ) {}
+      }
+
+      fc::ip::endpoint endpoint()const { return fc::ip::endpoint( fc::ip::address("127.0.0.1"), _port ); }
+
+      /** bytes sent by the node that connected to this link */
+      uint64_t bytes_out()const { return _dirs[0].bytes; }
+      /** bytes sent by the node this link connects to */
+      uint64_t bytes_in()const  { return _dirs[1].bytes; }
+
+   private:
+      struct direction
+      {
+         direction():from(nullptr),to(nullptr),bytes(0){}
+
+         fc::tcp_socket*                                          from;
+         fc::tcp_socket*                                          to;
+         std::deque<std::pair<fc::time_point,std::vector<char> > > in_flight;
+         fc::time_point                                           wire_free; ///< when the link has sent everything queued
+         fc::time_point                                           last_arrival;
+         network::inventory_scheduler                             deliver;
+         fc::future<void>                                         read_complete;
+         uint64_t                                                 bytes;
+      };
+
+      void accept()
+      { try {
+         _server.accept( _local );
+         _peer.connect_to( _remote );
+         _dirs[0].from = &_local; _dirs[0].to = &_peer;
+         _dirs[1].from = &_peer;  _dirs[1].to = &_local;
+         for( uint32_t i = 0; i < 2; ++i )
+         {
+            direction* d = &_dirs[i];
+            d->deliver.start( [=](){ deliver( *d ); } );
+            d->read_complete = fc::async( [=](){ read_loop( *d ); } );
+         }
+      }
+      catch ( const fc::exception& e )
+      {
+         wlog( "link to ${ep} failed: ${e}", ("ep",_remote)("e",e.to_detail_string()) );
+      } }
+
+      void read_loop( direction& d )
+      {
+         try {
+            std::vector<char> buf( 64*1024 );
+            while( true )
+            {
+               size_t s = d.from->readsome( buf.data(), buf.size() );
+               d.bytes += s;
+
+               auto now   = fc::time_point::now();
+               auto start = std::max( now, d.wire_free );
+               d.wire_free = start + fc::microseconds( s * 1000000ll / _profile.bytes_per_sec );
+
+               auto arrival = d.wire_free + _profile.latency;
+               if( std::uniform_real_distribution<double>(0,1)(_rng) < _profile.loss )
+               {
+                  arrival += fc::milliseconds(200) + _profile.latency + _profile.latency; // minimum RTO plus a round trip
+               }
+               // the stream is delivered in order, nothing can overtake a delayed chunk
+               d.last_arrival = std::max( arrival, d.last_arrival );
+
+               d.in_flight.push_back( std::make_pair( d.last_arrival, std::vector<char>( buf.begin(), buf.begin() + s ) ) );
+               d.deliver.notify_at( d.last_arrival );
+            }
+         }
+         catch ( ... )
+         {
+            d.to->close();
+         }
+      }
+
+      void deliver( direction& d )
+      {
+         auto now = fc::time_point::now();
+         while( d.in_flight.size() && d.in_flight.front().first <= now )
+         {
+            d.to->write( d.in_flight.front().second.data(), d.in_flight.front().second.size() );
+            d.in_flight.pop_front();
+         }
+         if( d.in_flight.size() )
+         {
+            d.deliver.notify_at( d.in_flight.front().first );
+         }
+      }
+
+      link_profile     _profile;
+      uint16_t         _port;
+      fc::ip::endpoint _remote;
+      std::mt19937     _rng;
+      fc::tcp_server   _server;
+      fc::tcp_socket   _local;
+      fc::tcp_socket   _peer;
+      direction        _dirs[2];
+      fc::future<void> _accept_complete;
+};
+
+/**
+ *  One full node and the time each injected item reached it.
+ */
+struct sim_node : public blockchain::channel_delegate,
+                  public bitname::name_channel_delegate,
+                  public bitchat::channel_delegate
+{
+   sim_node( const fc::path& dir, uint16_t port, const trx_block& genesis )
+   :port(port)
+   {
+      server = std::make_shared<network::server>();
+      network::server::config cfg;
+      cfg.port = port;
+      server->configure( cfg );
+
+      peers = std::make_shared<peer::peer_channel>( server );
+
+      chain = std::make_shared<blockchain_db>();
+      chain->open( dir / "chain" );
+      chain->push_block( genesis );
+      chain_channel = std::make_shared<blockchain::channel>( peers, chain, this );
+
+      names = std::make_shared<bitname::name_channel>( peers );
+      names->set_delegate( this );
+      bitname::name_channel::config name_cfg;
+      name_cfg.name_db_dir = dir / "names";
+      names->configure( name_cfg );
+
+      chat = std::make_shared<bitchat::channel>( peers, network::channel_id( network::chat_proto, 0 ), this );
+      chat->configure( bitchat::channel_config( dir / "chat" ) );
+   }
+
+   ~sim_node()
+   {
+      chat.reset();
+      names.reset();
+      chain_channel.reset();
+      peers.reset();
+      server->close();
+      chain->close();
+   }
+
+   fc::ip::endpoint endpoint()const { return fc::ip::endpoint( fc::ip::address("127.0.0.1"), port ); }
+
+   virtual void handle_trx_block( const trx_block& b )
+   {
+      block_arrivals[b.block_num] = fc::time_point::now();
+   }
+
+   virtual void handle_message( const bitchat::encrypted_message& m, const network::channel_id& c )
+   {
+      msg_arrivals[m.id()] = fc::time_point::now();
+   }
+
+   virtual void pending_name_trx( const bitname::name_header& ){}
+   virtual void name_block_added( const bitname::name_block& ){}
+
+   uint16_t                                port;
+   network::server_ptr                     server;
+   peer::peer_channel_ptr                  peers;
+   blockchain_db_ptr                       chain;
+   blockchain::channel_ptr                 chain_channel;
+   bitname::name_channel_ptr               names;
+   bitchat::channel_ptr                    chat;
+
+   std::map<uint32_t,fc::time_point>       block_arrivals;
+   std::map<fc::uint128,fc::time_point>    msg_arrivals;
+};
+
+/**
+ *  Waits until every node has the item or timeout passes and records how long
+ *  each node took to receive it.
+ */
+template<typename Key>
+uint32_t collect_delays( std::vector<std::unique_ptr<sim_node> >& nodes,
+                         std::map<Key,fc::time_point> sim_node::* arrivals,
+                         const Key& key, const fc::time_point& sent,
+                         std::vector<int64_t>& delays_us )
+{
+   auto deadline = sent + fc::seconds(30);
+   uint32_t received = 0;
+   while( true )
+   {
+      received = 0;
+      for( auto itr = nodes.begin(); itr != nodes.end(); ++itr )
+      {
+         received += ((**itr).*arrivals).count( key );
+      }
+      if( received == nodes.size() || fc::time_point::now() > deadline ) break;
+      fc::usleep( fc::milliseconds(5) );
+   }
+   for( auto itr = nodes.begin(); itr != nodes.end(); ++itr )
+   {
+      auto a = ((**itr).*arrivals).find( key );
+      if( a != ((**itr).*arrivals).end() && a->second != sent )
+      {
+         delays_us.push_back( (a->second - sent).count() );
+      }
+   }
+   return received;
+}
+
+void print_percentiles( const std::string& label, std::vector<int64_t> delays_us, uint32_t received, uint32_t expected )
+{
+   std::sort( delays_us.begin(), delays_us.end() );
+   auto pct = [&]( double p ) -> double
+   {
+      if( delays_us.empty() ) return 0;
+      return delays_us[ std::min<size_t>( delays_us.size() - 1, size_t(p * delays_us.size()) ) ] / 1000.0;
+   };
+   std::cout << label << ": " << received << "/" << expected << " delivered, "
+             << "p50 " << pct(0.50) << " ms, p90 " << pct(0.90) << " ms, p99 " << pct(0.99)
+             << " ms, max " << pct(1.0) << " ms\n";
+}
+
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t nodes_count  = argc >= 2 ? atoi( argv[1] ) : 8;
+      uint32_t degree       = argc >= 3 ? atoi( argv[2] ) : 3;
+      link_profile profile;
+      profile.latency       = fc::milliseconds( argc >= 4 ? atoi( argv[3] ) : 50 );
+      profile.bytes_per_sec = 1024 * (argc >= 5 ? atoi( argv[4] ) : 1024);
+      profile.loss          = (argc >= 6 ? atof( argv[5] ) : 0.0) / 100;
+      uint32_t blocks       = argc >= 7 ? atoi( argv[6] ) : 10;
+      uint32_t messages     = argc >= 8 ? atoi( argv[7] ) : 50;
+      uint16_t base_port    = 19000;
+
+      std::mt19937 rng( 42 );
+      fc::temp_directory temp_dir;
+
+      // every node starts from the same genesis, one output is spent per injected block
+      auto owner_key = fc::ecc::private_key::generate();
+      auto dest_key  = fc::ecc::private_key::generate();
+      auto genesis_time = fc::time_point::now() - fc::seconds( 31 * (blocks + 1) );
+
+      signed_transaction coinbase;
+      for( uint32_t i = 0; i < blocks; ++i )
+      {
+         coinbase.outputs.push_back( trx_output( claim_by_signature_output( bts::address( owner_key.get_public_key() ) ),
+                                                 asset( uint64_t(1000000), asset::bts ) ) );
+      }
+      trx_block genesis;
+      genesis.block_num    = 0;
+      genesis.timestamp    = genesis_time;
+      genesis.total_shares = 1000000ll * blocks;
+      genesis.trxs.push_back( coinbase );
+      genesis.trx_mroot    = genesis.calculate_merkle_root();
+      {
+         blockchain_db tmp;
+         tmp.open( temp_dir.path() / "fee" );
+         genesis.next_fee  = block_header::calculate_next_fee( tmp.get_fee_rate().get_rounded_amount(), genesis.block_size() );
+         tmp.close();
+      }
+
+      std::vector<std::unique_ptr<sim_node> > nodes;
+      for( uint32_t i = 0; i < nodes_count; ++i )
+      {
+         nodes.emplace_back( new sim_node( temp_dir.path() / fc::variant(i).as_string(), base_port + i, genesis ) );
+      }
+
+      // a ring keeps the network connected, the remaining connections are random
+      std::vector<std::unique_ptr<shaped_link> > links;
+      std::vector<std::pair<uint32_t,uint32_t> > link_nodes;
+      uint16_t link_port = base_port + nodes_count;
+      for( uint32_t i = 0; i < nodes_count; ++i )
+      {
+         for( uint32_t d = 0; d < degree && nodes_count > 1; ++d )
+         {
+            uint32_t j = d == 0 ? (i + 1) % nodes_count
+                                : std::uniform_int_distribution<uint32_t>( 0, nodes_count - 1 )( rng );
+            if( j == i ) continue;
+            links.emplace_back( new shaped_link( profile, link_port++, nodes[j]->endpoint(), rng() ) );
+            link_nodes.push_back( std::make_pair( i, j ) );
+            nodes[i]->server->connect_to( links.back()->endpoint() );
+         }
+      }
+      fc::usleep( fc::seconds(2) ); // let channel subscriptions settle
+
+      std::clock_t cpu_start  = std::clock();
+      uint32_t     deliveries = 0;
+
+      std::vector<int64_t> block_delays;
+      uint32_t             block_received = 0;
+      for( uint32_t i = 0; i < blocks; ++i )
+      {
+         auto& origin = *nodes[0];
+
+         signed_transaction spend;
+         spend.inputs.push_back( trx_input( output_reference( coinbase.id(), i ) ) );
+         spend.outputs.push_back( trx_output( claim_by_signature_output( bts::address( dest_key.get_public_key() ) ),
+                                              asset( uint64_t(999000), asset::bts ) ) );
+         spend.sign( owner_key );
+
+         trx_block blk;
+         blk.block_num    = origin.chain->head_block_num() + 1;
+         blk.prev         = origin.chain->head_block_id();
+         blk.timestamp    = genesis_time + fc::seconds( 31 * (i + 1) );
+         blk.total_shares = origin.chain->total_shares();
+         blk.trxs.push_back( spend );
+         blk.trx_mroot    = blk.calculate_merkle_root();
+         blk.next_fee     = block_header::calculate_next_fee( origin.chain->get_fee_rate().get_rounded_amount(), blk.block_size() );
+         while( blk.get_difficulty() < origin.chain->current_difficulty() ) ++blk.noncea;
+
+         auto sent = fc::time_point::now();
+         origin.chain->push_block( blk );
+         origin.block_arrivals[blk.block_num] = sent;
+         origin.chain_channel->broadcast( blk );
+
+         block_received += collect_delays( nodes, &sim_node::block_arrivals, blk.block_num, sent, block_delays );
+      }
+
+      std::vector<int64_t> msg_delays;
+      uint32_t             msg_received = 0;
+      for( uint32_t i = 0; i < messages; ++i )
+      {
+         auto& origin = *nodes[ std::uniform_int_distribution<uint32_t>( 0, nodes_count - 1 )( rng ) ];
+
+         bitchat::decrypted_message dm( bitchat::private_text_message( std::string( 1024, 'a' + i % 26 ) ) );
+         auto m = dm.encrypt( dest_key.get_public_key() );
+         m.timestamp = fc::time_point::now();
+         auto msg_id = m.id();
+
+         auto sent = fc::time_point::now();
+         origin.msg_arrivals[msg_id] = sent;
+         origin.chat->broadcast( std::move(m) );
+
+         msg_received += collect_delays( nodes, &sim_node::msg_arrivals, msg_id, sent, msg_delays );
+      }
+      deliveries = block_received + msg_received - blocks - messages; // the origin does not count
+
+      double cpu_us = double( std::clock() - cpu_start ) * 1000000 / CLOCKS_PER_SEC;
+
+      std::cout << nodes_count << " nodes, " << links.size() << " links, "
+                << profile.latency.count() / 1000 << " ms latency, "
+                << profile.bytes_per_sec / 1024 << " KB/s, " << profile.loss * 100 << "% loss\n";
+      print_percentiles( "block propagation", block_delays, block_received, blocks * nodes_count );
+      print_percentiles( "message propagation", msg_delays, msg_received, messages * nodes_count );
+      std::cout << "cpu: " << (deliveries ? cpu_us / deliveries : 0) << " us per delivered item\n";
+
+      std::vector<uint64_t> sent_bytes( nodes_count ), recv_bytes( nodes_count );
+      for( size_t l = 0; l < links.size(); ++l )
+      {
+         sent_bytes[link_nodes[l].first]  += links[l]->bytes_out();
+         recv_bytes[link_nodes[l].second] += links[l]->bytes_out();
+         sent_bytes[link_nodes[l].second] += links[l]->bytes_in();
+         recv_bytes[link_nodes[l].first]  += links[l]->bytes_in();
+      }
+      for( uint32_t i = 0; i < nodes_count; ++i )
+      {
+         std::cout << "node " << i << ": " << sent_bytes[i] << " bytes sent, " << recv_bytes[i] << " bytes received\n";
+      }
+
+      links.clear();
+      nodes.clear();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e", e.to_detail_string() ) );
+      return 1;
+   }
+   return 0;
+}
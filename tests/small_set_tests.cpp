@@ -0,0 +1,64 @@
+#define BOOST_TEST_MODULE SmallSetTest
+#include <boost/test/unit_test.hpp>
+
+#include <bts/small_set.hpp>
+
+#include <vector>
+
+BOOST_AUTO_TEST_CASE( insert_rejects_duplicates )
+{
+   bts::small_set<int,4> s;
+   BOOST_REQUIRE( s.empty() );
+   BOOST_REQUIRE( s.insert( 1 ).second );
+   BOOST_REQUIRE( s.insert( 2 ).second );
+   BOOST_REQUIRE( !s.insert( 1 ).second );
+   BOOST_REQUIRE( *s.insert( 2 ).first == 2 );
+   BOOST_REQUIRE( s.size() == 2 );
+   BOOST_REQUIRE( s.count( 1 ) == 1 );
+   BOOST_REQUIRE( s.count( 3 ) == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( spills_past_inline_capacity_in_order )
+{
+   bts::small_set<int,2> s;
+   for( int i = 0; i < 10; ++i )
+   {
+      BOOST_REQUIRE( s.insert( i ).second );
+   }
+   BOOST_REQUIRE( !s.insert( 0 ).second );
+   BOOST_REQUIRE( !s.insert( 9 ).second );
+   BOOST_REQUIRE( s.size() == 10 );
+
+   std::vector<int> items( s.begin(), s.end() );
+   for( int i = 0; i < 10; ++i )
+   {
+      BOOST_REQUIRE( items[i] == i );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( clear_after_spill )
+{
+   std::vector<int> items = { 5, 6, 7, 5 };
+   bts::small_set<int,2> s( items.begin(), items.end() );
+   BOOST_REQUIRE( s.size() == 3 );
+
+   s.clear();
+   BOOST_REQUIRE( s.empty() );
+   BOOST_REQUIRE( s.count( 5 ) == 0 );
+
+   BOOST_REQUIRE( s.insert( 7 ).second );
+   BOOST_REQUIRE( *s.begin() == 7 );
+   BOOST_REQUIRE( s.size() == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( variant_round_trip )
+{
+   std::vector<int> items = { 3, 1, 2 };
+   bts::small_set<int,2> s( items.begin(), items.end() );
+
+   fc::variant v;
+   fc::to_variant( s, v );
+   bts::small_set<int,2> copy;
+   fc::from_variant( v, copy );
+   BOOST_REQUIRE( std::vector<int>( copy.begin(), copy.end() ) == items );
+}
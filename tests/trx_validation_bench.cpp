@@ -0,0 +1,95 @@
+#include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/trx_validation_state.hpp>
+#include <bts/address.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+/**
+ *  Counts every heap allocation made by the process so that the cost of
+ *  validating a single signature transaction can be measured.
+ */
+static std::atomic<uint64_t> allocation_count(0);
+
+void* operator new( size_t s )
+{
+   ++allocation_count;
+   void* p = malloc( s ? s : 1 );
+   if( !p ) throw std::bad_alloc();
+   return p;
+}
+void operator delete( void* p ) noexcept { free(p); }
+void* operator new[]( size_t s ) { return operator new(s); }
+void operator delete[]( void* p ) noexcept { free(p); }
+
+using namespace bts::blockchain;
+
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t rounds = argc >= 2 ? atoi( argv[1] ) : 1000;
+
+      fc::temp_directory temp_dir;
+      blockchain_db chain;
+      chain.open( temp_dir.path() / "chain" );
+
+      auto owner_key = fc::ecc::private_key::generate();
+      auto dest_key  = fc::ecc::private_key::generate();
+
+      signed_transaction coinbase;
+      coinbase.outputs.push_back( trx_output( claim_by_signature_output( bts::address( owner_key.get_public_key() ) ),
+                                              asset( uint64_t(1000000), asset::bts ) ) );
+      trx_block genesis;
+      genesis.block_num    = 0;
+      genesis.timestamp    = fc::time_point::now();
+      genesis.total_shares = 1000000;
+      genesis.trxs.push_back( coinbase );
+      genesis.trx_mroot    = genesis.calculate_merkle_root();
+      genesis.next_fee     = block_header::calculate_next_fee( chain.get_fee_rate().get_rounded_amount(), genesis.block_size() );
+      chain.push_block( genesis );
+
+      signed_transaction spend;
+      spend.inputs.push_back( trx_input( output_reference( coinbase.id(), 0 ) ) );
+      spend.outputs.push_back( trx_output( claim_by_signature_output( bts::address( dest_key.get_public_key() ) ),
+                                           asset( uint64_t(999000), asset::bts ) ) );
+      spend.sign( owner_key );
+
+      chain.evaluate_signed_transaction( spend, true ); // warm up caches
+
+      uint64_t start_allocs = allocation_count;
+      auto     start        = fc::time_point::now();
+      for( uint32_t i = 0; i < rounds; ++i )
+      {
+         chain.evaluate_signed_transaction( spend, true );
+      }
+      auto     elapsed      = fc::time_point::now() - start;
+      uint64_t allocs       = allocation_count - start_allocs;
+
+      std::cout << "evaluate_signed_transaction: " << rounds << " rounds, "
+                << double(allocs) / rounds << " allocations/trx, "
+                << double(elapsed.count()) / rounds << " us/trx\n";
+
+      start_allocs = allocation_count;
+      for( uint32_t i = 0; i < rounds; ++i )
+      {
+         trx_validation_state state( spend, &chain );
+         state.validate();
+      }
+      allocs = allocation_count - start_allocs;
+      std::cout << "trx_validation_state::validate: " << double(allocs) / rounds << " allocations/trx\n";
+
+      chain.close();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e", e.to_detail_string() ) );
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE WalletJournalTest
+#include <boost/test/unit_test.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/crypto/elliptic.hpp>
+
+#include <bts/blockchain/blockchain_wallet.hpp>
+#include <bts/address.hpp>
+
+#include <fstream>
+
+using namespace bts::blockchain;
+
+const std::string base_password = "base password";
+const std::string key_password  = "key password";
+
+bts::address random_address()
+{
+   return bts::address( fc::ecc::private_key::generate().get_public_key() );
+}
+
+/** creates a wallet at p and journals a send address to it */
+bts::address create_with_journal( const fc::path& p )
+{
+   wallet w;
+   w.create( p, base_password, key_password );
+   auto addr = random_address();
+   w.add_send_address( addr, "journaled" );
+   w.save();
+   BOOST_REQUIRE( fc::exists( fc::path( p.generic_string() + ".journal" ) ) );
+   return addr;
+}
+
+void append_to_journal( const fc::path& p, const char* data, size_t len )
+{
+   std::ofstream out( (p.generic_string() + ".journal").c_str(), std::ios::out | std::ios::binary | std::ios::app );
+   out.write( data, len );
+}
+
+BOOST_AUTO_TEST_CASE( journal_replayed_on_open )
+{
+   fc::temp_directory dir;
+   auto p    = dir.path() / "wallet.dat";
+   auto addr = create_with_journal( p );
+
+   wallet w;
+   w.open( p, base_password );
+   BOOST_REQUIRE( w.get_send_addresses().count( addr ) == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( journal_written_while_locked )
+{
+   fc::temp_directory dir;
+   auto p = dir.path() / "wallet.dat";
+   create_with_journal( p );
+
+   auto addr = random_address();
+   {
+      wallet w;
+      w.open( p, base_password );
+      w.lock_wallet();
+      BOOST_REQUIRE( w.is_locked() );
+      w.add_send_address( addr, "locked" );
+      w.save();
+   }
+
+   wallet w;
+   w.open( p, base_password );
+   BOOST_REQUIRE( w.get_send_addresses().count( addr ) == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( truncated_journal_record_ignored )
+{
+   fc::temp_directory dir;
+   auto p    = dir.path() / "wallet.dat";
+   auto addr = create_with_journal( p );
+
+   // an append interrupted after part of the length prefix
+   char partial[2] = { 1, 0 };
+   append_to_journal( p, partial, sizeof(partial) );
+
+   wallet w;
+   w.open( p, base_password );
+   BOOST_REQUIRE( w.get_send_addresses().count( addr ) == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( corrupt_journal_length_ignored )
+{
+   fc::temp_directory dir;
+   auto p    = dir.path() / "wallet.dat";
+   auto addr = create_with_journal( p );
+
+   uint32_t huge_length = 0xffffffff;
+   append_to_journal( p, (const char*)&huge_length, sizeof(huge_length) );
+   append_to_journal( p, "abc", 3 );
+
+   wallet w;
+   w.open( p, base_password );
+   BOOST_REQUIRE( w.get_send_addresses().count( addr ) == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( create_discards_stale_journal )
+{
+   fc::temp_directory dir;
+   auto p    = dir.path() / "wallet.dat";
+   auto addr = create_with_journal( p );
+   fc::remove( p );
+
+   {
+      wallet w;
+      w.create( p, base_password, key_password );
+   }
+
+   wallet w;
+   w.open( p, base_password );
+   BOOST_REQUIRE( w.get_send_addresses().count( addr ) == 0 );
+}